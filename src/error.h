@@ -49,7 +49,18 @@
 
 typedef uint8_t specasm_error_t;
 
-extern specasm_error_t err_type;
+/*
+ * On the host the current file and error state are per thread, allowing
+ * object files to be loaded in parallel by the linker.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#define SPECASM_THREAD_LOCAL _Thread_local
+#else
+#define SPECASM_THREAD_LOCAL
+#endif
+
+extern SPECASM_THREAD_LOCAL specasm_error_t err_type;
 
 extern const char *error_msgs[SPECASM_MAX_ERRORS];
 
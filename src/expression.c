@@ -20,6 +20,10 @@
 
 #include "error.h"
 #include "expression.h"
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include "link_refs.h"
+#endif
+#include "link_stats.h"
 #include "salink.h"
 #include "state_base.h"
 
@@ -84,13 +88,26 @@
 #define SALINK_TOKEN_LSL_VAL 1
 #define SALINK_TOKEN_ASR_VAL 2
 
+/*
+ * The maximum nesting of brackets and unary operators in an expression.
+ * On the Spectrum this also limits the nesting of EQUs, as EQUs are
+ * evaluated when they're first used.  On the host the EQUs an EQU
+ * depends on are always evaluated before it, so EQUs can be nested to
+ * any depth and an expression can nest as deeply as there's room for in
+ * a line.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#define SALINK_MAX_DEPTH (SPECASM_LINE_MAX_LEN / 2)
+#else
 #define SALINK_MAX_DEPTH 3
+#endif
 
 struct salink_token_t_ {
 	uint8_t type;
 	union {
 		int16_t num;
-		uint8_t id;
+		uint16_t id;
 	} data;
 };
 
@@ -104,7 +121,16 @@ struct salink_exp_stack_entry_t_ {
 
 typedef struct salink_exp_stack_entry_t_ salink_exp_stack_entry_t;
 
+/*
+ * On the host, the evaluation of an expression can be interrupted once
+ * to evaluate the EQUs it uses, so we need room for two expressions.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+static salink_exp_stack_entry_t g_stack[(SALINK_MAX_DEPTH + 1) * 2];
+#else
 static salink_exp_stack_entry_t g_stack[SALINK_MAX_DEPTH + 1];
+#endif
 static uint8_t g_stack_top;
 
 static salink_obj_t *g_obj;
@@ -115,7 +141,7 @@ static void prv_equ_eval_local_e(salink_label_t *label, uint8_t depth,
 				 uint16_t line_no);
 void salink_equ_eval_global_banked_e(salink_obj_t *obj, salink_global_t *global,
 				     salink_label_t *label, uint8_t depth);
-static const char simple_ops[] = "()/*+-&|^~";
+static const char simple_ops[] = "()/*%+-&|^~";
 
 static const char zx81_conseq_ops[] = {'"', '#', '$', ':', '?', '(',
 				       ')', '>', '<', '=', '+', '-',
@@ -156,10 +182,11 @@ static void prv_unknown_error_label_e(salink_obj_t *obj, const char *str)
 /*
  * Find a label id given a string.  We need this when evaluating expressions.
  * Labels within expressions are encoded as strings rather than as ids.
+ * Returns SALINK_NO_LABEL if there's no such label.
  */
 
-static unsigned int prv_find_local_label_e(const char *str, int len,
-					   salink_obj_t *obj)
+static unsigned int prv_match_local_label_e(const char *str, int len,
+					    salink_obj_t *obj)
 {
 	unsigned int i;
 	salink_label_t *label;
@@ -167,6 +194,7 @@ static unsigned int prv_find_local_label_e(const char *str, int len,
 	uint8_t lng = len >= SPECASM_MAX_SHORT_LEN ? 1 : 0;
 	uint8_t lab_lng;
 
+	salink_stats_count(label_lookups, 1);
 	for (i = obj->label_start; i < obj->label_end; i++) {
 		label = &labels[i];
 		if ((label->type == SALINK_LABEL_TYPE_ALIGN) ||
@@ -179,15 +207,30 @@ static unsigned int prv_find_local_label_e(const char *str, int len,
 
 		lab_str = salink_get_label_str_e(label->id, lng);
 		if (err_type != SPECASM_ERROR_OK)
-			return 0;
+			return SALINK_NO_LABEL;
 
 		if (!strcmp(str, lab_str))
 			return i;
 	}
 
-	prv_unknown_error_label_e(obj, str);
+	return SALINK_NO_LABEL;
+}
 
-	return 0;
+static unsigned int prv_find_local_label_e(const char *str, int len,
+					   salink_obj_t *obj)
+{
+	unsigned int i;
+
+	i = prv_match_local_label_e(str, len, obj);
+	if (err_type != SPECASM_ERROR_OK)
+		return 0;
+
+	if (i == SALINK_NO_LABEL) {
+		prv_unknown_error_label_e(obj, str);
+		return 0;
+	}
+
+	return i;
 }
 
 /*
@@ -196,14 +239,11 @@ static unsigned int prv_find_local_label_e(const char *str, int len,
 
 static unsigned int prv_find_global_label_e(const char *str, salink_obj_t *obj)
 {
-	unsigned int i;
 	salink_global_t *global;
 
-	for (i = 0; i < global_count; i++) {
-		global = &globals[i];
-		if (!strcmp(str, global->name))
-			return i;
-	}
+	global = salink_find_global(str);
+	if (global)
+		return global - globals;
 
 	prv_unknown_error_label_e(obj, str);
 
@@ -328,11 +368,279 @@ const char *prv_get_token_e(const char *buf, salink_token_t *tok,
 	return NULL;
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * On the host, an EQU that has not yet been evaluated is evaluated along
+ * with all the unevaluated EQUs it depends on, in dependency order.  The
+ * dependencies are found by a depth first search of the names in the
+ * EQUs' expressions.  The search uses its own stack so there's no limit
+ * on the length of a chain of EQUs.  Each EQU is evaluated once, after
+ * the EQUs it depends on, so the evaluation of an EQU never needs to
+ * evaluate another.  The EQUs on the stack are marked as busy.  Finding
+ * a busy EQU in an expression means the EQUs are recursive, and the
+ * chain of EQUs involved is reported.
+ *
+ * Global EQUs can only depend on other global EQUs.  Local EQUs can
+ * depend on local EQUs in the same object and on global EQUs.
+ */
+
+struct salink_equ_frame_t_ {
+	uint16_t label;
+	salink_global_t *global;
+	const char *pos;
+};
+typedef struct salink_equ_frame_t_ salink_equ_frame_t;
+
+static uint8_t equ_busy[MAX_LABELS];
+
+static const char *prv_equ_name_e(const salink_equ_frame_t *frame)
+{
+	salink_label_t *label = &labels[frame->label];
+
+	if (frame->global)
+		return frame->global->name;
+
+	return salink_get_label_str_e(label->id, label->type);
+}
+
+/*
+ * Returns the index of the label of the unevaluated EQU referred to by
+ * name, or SALINK_NO_LABEL if name doesn't refer to one.
+ */
+
+static unsigned int prv_equ_dep_e(const char *name, uint8_t from_global,
+				   salink_global_t **global)
+{
+	unsigned int i;
+	uint8_t type;
+
+	*global = NULL;
+	if ((name[0] >= 'A') && (name[0] <= 'Z')) {
+		*global = salink_find_global(name);
+		if (!*global)
+			return SALINK_NO_LABEL;
+		i = (*global)->label_index;
+		if (labels[i].type != SALINK_LABEL_TYPE_EQU_GLOBAL)
+			return SALINK_NO_LABEL;
+		return i;
+	}
+
+	/*
+	 * Global EQUs can't refer to locals.  This is reported when the EQU
+	 * is evaluated.
+	 */
+
+	if (from_global)
+		return SALINK_NO_LABEL;
+
+	i = prv_match_local_label_e(name, strlen(name), g_obj);
+	if (i == SALINK_NO_LABEL)
+		return SALINK_NO_LABEL;
+	type = labels[i].type;
+	if ((type != SALINK_LABEL_TYPE_EQU_SHORT) &&
+	    (type != SALINK_LABEL_TYPE_EQU_LONG))
+		return SALINK_NO_LABEL;
+
+	return i;
+}
+
+static void prv_equ_cycle_e(const salink_equ_frame_t *stack, unsigned int top,
+			    unsigned int label)
+{
+	unsigned int i = top;
+	const char *name;
+	size_t len;
+
+	while (stack[--i].label != label)
+		;
+
+	len = snprintf(error_buf, sizeof(error_buf), "Recursive EQU ");
+	for (; i < top; i++) {
+		name = prv_equ_name_e(&stack[i]);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+		if (len < sizeof(error_buf))
+			len += snprintf(&error_buf[len], sizeof(error_buf) - len,
+					"%s -> ", name);
+	}
+	for (i = 0; stack[i].label != label; i++)
+		;
+	name = prv_equ_name_e(&stack[i]);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+	if (len < sizeof(error_buf))
+		len += snprintf(&error_buf[len], sizeof(error_buf) - len, "%s",
+				name);
+	if (!stack[i].global && (len < sizeof(error_buf)))
+		snprintf(&error_buf[len], sizeof(error_buf) - len, " in %s",
+			 g_obj->fname);
+	err_type = SALINK_ERROR_RECURISVE_EQU;
+}
+
+static void prv_equ_push_e(salink_equ_frame_t **stack, unsigned int *top,
+			   unsigned int *max, unsigned int label,
+			   salink_global_t *global)
+{
+	salink_equ_frame_t *new_stack;
+	salink_equ_frame_t *frame;
+	salink_label_t *l = &labels[label];
+
+	if (*top == *max) {
+		*max = *max ? *max * 2 : 16;
+		new_stack = realloc(*stack, *max * sizeof(**stack));
+		if (!new_stack) {
+			strcpy(error_buf, "Out of memory");
+			err_type = SALINK_ERROR_NO_MEMORY;
+			return;
+		}
+		*stack = new_stack;
+	}
+
+	frame = &(*stack)[*top];
+	frame->label = label;
+	frame->global = global;
+	if (global)
+		frame->pos = global->name + strlen(global->name) + 1;
+	else
+		frame->pos = salink_get_label_str_e(l->data.equ[1],
+						    l->data.equ[0]);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+	equ_busy[label] = 1;
+	(*top)++;
+}
+
+static void prv_equ_eval_deps_e(unsigned int label, salink_global_t *global,
+				uint16_t line_no)
+{
+	char name[SPECASM_LINE_MAX_LEN + 1];
+	salink_equ_frame_t *stack = NULL;
+	salink_equ_frame_t *frame;
+	salink_global_t *dep_global;
+	unsigned int dep;
+	unsigned int top = 0;
+	unsigned int max = 0;
+	salink_obj_t *obj = g_obj;
+
+	prv_equ_push_e(&stack, &top, &max, label, global);
+
+	while ((top > 0) && (err_type == SPECASM_ERROR_OK)) {
+		frame = &stack[top - 1];
+		frame->pos = salink_next_ident(frame->pos, name);
+		if (frame->pos) {
+			dep = prv_equ_dep_e(name, frame->global != NULL,
+					    &dep_global);
+			if ((err_type != SPECASM_ERROR_OK) ||
+			    (dep == SALINK_NO_LABEL))
+				continue;
+			if (equ_busy[dep])
+				prv_equ_cycle_e(stack, top, dep);
+			else
+				prv_equ_push_e(&stack, &top, &max, dep,
+					       dep_global);
+			continue;
+		}
+
+		top--;
+		equ_busy[frame->label] = 0;
+		if (frame->global) {
+			salink_equ_eval_global_e(
+			    &obj_files[frame->global->obj_index], frame->global,
+			    &labels[frame->label], 0);
+			g_obj = obj;
+		} else {
+			prv_equ_eval_local_e(&labels[frame->label], 0, line_no);
+		}
+	}
+
+	while (top > 0)
+		equ_busy[stack[--top].label] = 0;
+	free(stack);
+}
+#endif
+
+/*
+ * Returns the value of a label referenced by an expression at the given
+ * depth, evaluating it first if it's an EQU that has not yet been
+ * evaluated.
+ */
+
+static int16_t prv_local_label_value_e(salink_label_t *label, uint8_t depth,
+				       uint16_t line_no)
+{
+	switch (label->type) {
+	case SALINK_LABEL_TYPE_SHORT:
+	case SALINK_LABEL_TYPE_LNG:
+	case SALINK_LABEL_TYPE_EQU_EVAL_SHORT:
+	case SALINK_LABEL_TYPE_EQU_EVAL_LONG:
+		break;
+	case SALINK_LABEL_TYPE_EQU_SHORT:
+	case SALINK_LABEL_TYPE_EQU_LONG:
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		prv_equ_eval_deps_e(label - labels, NULL, line_no);
+#else
+		if (depth == SALINK_MAX_DEPTH) {
+			err_type = SALINK_ERROR_RECURISVE_EQU;
+			return 0;
+		}
+		prv_equ_eval_local_e(label, depth + 1, line_no);
+#endif
+		if (err_type != SPECASM_ERROR_OK)
+			return 0;
+		break;
+	default:
+		/* Should not happen so not worth a proper error */
+
+		err_type = SPECASM_ERROR_BAD_LABEL;
+		return 0;
+	}
+
+	return label->data.off;
+}
+
+static int16_t prv_global_label_value_e(salink_global_t *global,
+					uint8_t depth)
+{
+	salink_label_t *label = &labels[global->label_index];
+
+	switch (label->type) {
+	case SALINK_LABEL_TYPE_SHORT:
+	case SALINK_LABEL_TYPE_LNG:
+	case SALINK_LABEL_TYPE_EQU_EVAL_GLOBAL:
+		break;
+	case SALINK_LABEL_TYPE_EQU_GLOBAL:
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		prv_equ_eval_deps_e(global->label_index, global,
+				    global->line_no);
+#else
+		if (depth == SALINK_MAX_DEPTH) {
+			err_type = SALINK_ERROR_RECURISVE_EQU;
+			return 0;
+		}
+#ifdef SPECASM_NEXT_BANKED
+		salink_equ_eval_global_banked_e(g_obj, global, label,
+						depth + 1);
+#else
+		salink_equ_eval_global_e(g_obj, global, label, depth + 1);
+#endif
+#endif
+		if (err_type != SPECASM_ERROR_OK)
+			return 0;
+		break;
+	default:
+		/* Should not happen so not worth a proper error */
+
+		err_type = SPECASM_ERROR_BAD_LABEL;
+		return 0;
+	}
+
+	return label->data.off;
+}
+
 static const char *prv_exp_priority0_e(const char *str, int16_t *e)
 {
 	salink_token_t tok;
-	salink_label_t *label;
-	salink_global_t *global;
 	uint8_t is_global = g_stack[g_stack_top -1].is_global;
 	uint16_t line_no = g_stack[g_stack_top - 1].line_no;
 	uint8_t depth = g_stack[g_stack_top - 1].depth;
@@ -388,63 +696,15 @@ static const char *prv_exp_priority0_e(const char *str, int16_t *e)
 			err_type = SALINK_ERROR_LOCAL_IN_GLOBAL_EQU;
 			return NULL;
 		}
-		label = &labels[tok.data.id];
-		switch (label->type) {
-		case SALINK_LABEL_TYPE_SHORT:
-		case SALINK_LABEL_TYPE_LNG:
-		case SALINK_LABEL_TYPE_EQU_EVAL_SHORT:
-		case SALINK_LABEL_TYPE_EQU_EVAL_LONG:
-			*e = label->data.off;
-			break;
-		case SALINK_LABEL_TYPE_EQU_SHORT:
-		case SALINK_LABEL_TYPE_EQU_LONG:
-			if (depth == SALINK_MAX_DEPTH) {
-				err_type = SALINK_ERROR_RECURISVE_EQU;
-				return NULL;
-			}
-			prv_equ_eval_local_e(label, depth + 1, line_no);
-			if (err_type != SPECASM_ERROR_OK)
-				return NULL;
-			*e = label->data.off;
-			break;
-		default:
-			/* Should not happen so not worth a proper error */
-
-			err_type = SPECASM_ERROR_BAD_LABEL;
+		*e = prv_local_label_value_e(&labels[tok.data.id], depth,
+					     line_no);
+		if (err_type != SPECASM_ERROR_OK)
 			return NULL;
-		}
 		break;
 	case SALINK_TOKEN_GLOBAL_LABEL:
-		global = &globals[tok.data.id];
-		label = &labels[global->label_index];
-		switch (label->type) {
-		case SALINK_LABEL_TYPE_SHORT:
-		case SALINK_LABEL_TYPE_LNG:
-		case SALINK_LABEL_TYPE_EQU_EVAL_GLOBAL:
-			*e = label->data.off;
-			break;
-		case SALINK_LABEL_TYPE_EQU_GLOBAL:
-			if (depth == SALINK_MAX_DEPTH) {
-				err_type = SALINK_ERROR_RECURISVE_EQU;
-				return NULL;
-			}
-#ifdef SPECASM_NEXT_BANKED
-			salink_equ_eval_global_banked_e(g_obj, global, label,
-							depth + 1);
-#else
-			salink_equ_eval_global_e(g_obj, global, label,
-						 depth + 1);
-#endif
-			if (err_type != SPECASM_ERROR_OK)
-				return NULL;
-			*e = label->data.off;
-			break;
-		default:
-			/* Should not happen so not worth a proper error */
-
-			err_type = SPECASM_ERROR_BAD_LABEL;
+		*e = prv_global_label_value_e(&globals[tok.data.id], depth);
+		if (err_type != SPECASM_ERROR_OK)
 			return NULL;
-		}
 		break;
 	default:
 		err_type = SPECASM_ERROR_BAD_LABEL;
@@ -649,6 +909,7 @@ static int16_t prv_equ_eval_e(const char *name, uint8_t depth,
 	int16_t e;
 	salink_token_t tok;
 
+	salink_stats_count(exp_evals, 1);
 	g_stack[g_stack_top].is_global = is_global;
 	g_stack[g_stack_top].depth = depth;
 	g_stack[g_stack_top].line_no = line_no;
@@ -767,6 +1028,350 @@ void salink_equ_eval_global_e(salink_obj_t *obj, salink_global_t *global,
 	label->type = SALINK_LABEL_TYPE_EQU_EVAL_GLOBAL;
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * On the host, the expressions used by instructions are compiled, the
+ * first time they're used, into a list of operations in reverse polish
+ * notation, with their labels already looked up.  The compiled
+ * expressions are cached by the type and id of their strings in the
+ * object that uses them, so an expression used by many lines of an
+ * object, as is common in tables, is only parsed once.  The values of
+ * the labels are still read each time the expression is evaluated.
+ *
+ * The compiler follows the structure of the parser above, including its
+ * handling of unary operators, which apply to the whole expression that
+ * follows them.  If an expression fails to compile we fall back to the
+ * parser, so that any errors are reported exactly as before.
+ */
+
+#define SALINK_RPN_NUM 0
+#define SALINK_RPN_LOCAL 1
+#define SALINK_RPN_GLOBAL 2
+#define SALINK_RPN_NEG 3
+#define SALINK_RPN_NOT 4
+#define SALINK_RPN_LSL 5
+#define SALINK_RPN_ASR 6
+
+/*
+ * Each token of an expression generates at most one operation.
+ */
+
+#define SALINK_RPN_MAX_OPS SPECASM_LINE_MAX_LEN
+
+struct salink_rpn_op_t_ {
+	uint8_t op;
+	uint8_t depth;
+	union {
+		int16_t num;
+		uint16_t index;
+	} data;
+};
+typedef struct salink_rpn_op_t_ salink_rpn_op_t;
+
+struct salink_rpn_t_ {
+	uint8_t num_ops;
+	salink_rpn_op_t ops[];
+};
+
+static salink_rpn_op_t rpn_ops[SALINK_RPN_MAX_OPS];
+static uint8_t rpn_num_ops;
+static uint8_t rpn_depth;
+
+/*
+ * The binary operators, by priority, and the operations they compile to.
+ */
+
+static const char rpn_binary_ops[4][4] = {
+    {'*', '/', '%'},
+    {'+', '-'},
+    {SALINK_TOKEN_LSL_VAL, SALINK_TOKEN_ASR_VAL},
+    {'&', '|', '^'},
+};
+
+static void prv_rpn_emit_e(uint8_t op, uint16_t data)
+{
+	salink_rpn_op_t *rop;
+
+	if (rpn_num_ops == SALINK_RPN_MAX_OPS) {
+		err_type = SALINK_ERROR_BAD_EXPRESSION;
+		return;
+	}
+	rop = &rpn_ops[rpn_num_ops++];
+	rop->op = op;
+	rop->depth = rpn_depth;
+	rop->data.index = data;
+}
+
+static const char *prv_rpn_priority_e(const char *str, uint8_t priority);
+
+static const char *prv_rpn_operand_e(const char *str)
+{
+	salink_token_t tok;
+	uint8_t op;
+
+	str = prv_get_token_e(str, &tok, 0);
+	if (err_type != SPECASM_ERROR_OK)
+		return NULL;
+
+	switch (tok.type) {
+	case SALINK_TOKEN_OP:
+		if (rpn_depth == SALINK_MAX_DEPTH) {
+			err_type = SALINK_ERROR_RECURISVE_EQU;
+			return NULL;
+		}
+		rpn_depth++;
+		str = prv_rpn_priority_e(str, 4);
+		if (err_type != SPECASM_ERROR_OK)
+			return NULL;
+		rpn_depth--;
+
+		if (tok.data.id == '(') {
+			str = prv_get_token_e(str, &tok, 0);
+			if (err_type != SPECASM_ERROR_OK)
+				return NULL;
+			if ((tok.type != SALINK_TOKEN_OP) ||
+			    (tok.data.id != ')'))
+				err_type = SALINK_ERROR_BAD_EXPRESSION;
+			return str;
+		} else if (tok.data.id == '-') {
+			op = SALINK_RPN_NEG;
+		} else if (tok.data.id == '~') {
+			op = SALINK_RPN_NOT;
+		} else {
+			err_type = SALINK_ERROR_BAD_EXPRESSION;
+			return NULL;
+		}
+		prv_rpn_emit_e(op, 0);
+		break;
+	case SALINK_TOKEN_NUM:
+		prv_rpn_emit_e(SALINK_RPN_NUM, (uint16_t)tok.data.num);
+		break;
+	case SALINK_TOKEN_LOCAL_LABEL:
+		prv_rpn_emit_e(SALINK_RPN_LOCAL, tok.data.id);
+		break;
+	case SALINK_TOKEN_GLOBAL_LABEL:
+		prv_rpn_emit_e(SALINK_RPN_GLOBAL, tok.data.id);
+		break;
+	default:
+		err_type = SALINK_ERROR_BAD_EXPRESSION;
+		return NULL;
+	}
+
+	return str;
+}
+
+static const char *prv_rpn_priority_e(const char *str, uint8_t priority)
+{
+	salink_token_t tok;
+	const char *next;
+	const char *ops;
+	uint8_t op;
+
+	if (priority == 0)
+		return prv_rpn_operand_e(str);
+
+	str = prv_rpn_priority_e(str, priority - 1);
+	if (err_type != SPECASM_ERROR_OK)
+		return NULL;
+
+	next = prv_get_token_e(str, &tok, 0);
+	if (err_type != SPECASM_ERROR_OK)
+		return NULL;
+
+	ops = rpn_binary_ops[priority - 1];
+	while ((tok.type == SALINK_TOKEN_OP) &&
+	       memchr(ops, tok.data.id, sizeof(rpn_binary_ops[0]))) {
+		op = tok.data.id;
+		str = prv_rpn_priority_e(next, priority - 1);
+		if (err_type != SPECASM_ERROR_OK)
+			return NULL;
+
+		if (op == SALINK_TOKEN_LSL_VAL)
+			op = SALINK_RPN_LSL;
+		else if (op == SALINK_TOKEN_ASR_VAL)
+			op = SALINK_RPN_ASR;
+		prv_rpn_emit_e(op, 0);
+		if (err_type != SPECASM_ERROR_OK)
+			return NULL;
+
+		next = prv_get_token_e(str, &tok, 0);
+		if (err_type != SPECASM_ERROR_OK)
+			return NULL;
+	}
+
+	return str;
+}
+
+static struct salink_rpn_t_ *prv_rpn_compile(const char *str)
+{
+	salink_token_t tok;
+	struct salink_rpn_t_ *rpn;
+	size_t ops_size;
+
+	rpn_num_ops = 0;
+	rpn_depth = 0;
+
+	str = prv_rpn_priority_e(str, 4);
+	if (err_type == SPECASM_ERROR_OK) {
+		(void)prv_get_token_e(str, &tok, 0);
+		if (tok.type != SALINK_TOKEN_EOF)
+			err_type = SALINK_ERROR_BAD_EXPRESSION;
+	}
+
+	if (err_type != SPECASM_ERROR_OK) {
+		err_type = SPECASM_ERROR_OK;
+		error_buf[0] = 0;
+		return NULL;
+	}
+
+	ops_size = rpn_num_ops * sizeof(rpn_ops[0]);
+	rpn = malloc(sizeof(*rpn) + ops_size);
+	if (!rpn)
+		return NULL;
+	rpn->num_ops = rpn_num_ops;
+	memcpy(rpn->ops, rpn_ops, ops_size);
+
+	return rpn;
+}
+
+static int16_t prv_rpn_eval_e(const struct salink_rpn_t_ *rpn,
+			      uint16_t line_no)
+{
+	int16_t stack[SALINK_RPN_MAX_OPS];
+	const salink_rpn_op_t *rop;
+	uint8_t top = 0;
+	uint8_t i;
+	int16_t e2;
+
+	salink_stats_count(exp_evals, 1);
+	for (i = 0; i < rpn->num_ops; i++) {
+		rop = &rpn->ops[i];
+		switch (rop->op) {
+		case SALINK_RPN_NUM:
+			stack[top++] = rop->data.num;
+			continue;
+		case SALINK_RPN_LOCAL:
+			stack[top++] = prv_local_label_value_e(
+			    &labels[rop->data.index], rop->depth, line_no);
+			if (err_type != SPECASM_ERROR_OK)
+				return 0;
+			continue;
+		case SALINK_RPN_GLOBAL:
+			stack[top++] = prv_global_label_value_e(
+			    &globals[rop->data.index], rop->depth);
+			if (err_type != SPECASM_ERROR_OK)
+				return 0;
+			continue;
+		case SALINK_RPN_NEG:
+			stack[top - 1] = -stack[top - 1];
+			continue;
+		case SALINK_RPN_NOT:
+			stack[top - 1] = ~stack[top - 1];
+			continue;
+		}
+
+		e2 = stack[--top];
+		switch (rop->op) {
+		case '*':
+			stack[top - 1] *= e2;
+			break;
+		case '/':
+			if (e2 == 0) {
+				err_type = SALINK_ERROR_DIV_ZERO;
+				return 0;
+			}
+			stack[top - 1] /= e2;
+			break;
+		case '%':
+			if (e2 == 0) {
+				err_type = SALINK_ERROR_DIV_ZERO;
+				return 0;
+			}
+			stack[top - 1] %= e2;
+			break;
+		case '+':
+			stack[top - 1] += e2;
+			break;
+		case '-':
+			stack[top - 1] -= e2;
+			break;
+		case SALINK_RPN_LSL:
+			stack[top - 1] <<= e2;
+			break;
+		case SALINK_RPN_ASR:
+			stack[top - 1] >>= e2;
+			break;
+		case '&':
+			stack[top - 1] &= e2;
+			break;
+		case '|':
+			stack[top - 1] |= e2;
+			break;
+		case '^':
+			stack[top - 1] ^= e2;
+			break;
+		}
+	}
+
+	return stack[0];
+}
+
+static struct salink_rpn_t_ **prv_rpn_slot(salink_obj_t *obj, uint8_t id,
+					   uint8_t lng)
+{
+	if (!obj->exps) {
+		obj->exps = calloc(SPECASM_MAX_SHORT_STRINGS +
+				       SPECASM_MAX_LONG_STRINGS,
+				   sizeof(*obj->exps));
+		if (!obj->exps)
+			return NULL;
+	}
+
+	return &obj->exps[lng ? SPECASM_MAX_SHORT_STRINGS + id : id];
+}
+
+void salink_free_expressions(salink_obj_t *obj)
+{
+	unsigned int i;
+
+	if (!obj->exps)
+		return;
+
+	for (i = 0; i < SPECASM_MAX_SHORT_STRINGS + SPECASM_MAX_LONG_STRINGS;
+	     i++)
+		free(obj->exps[i]);
+	free(obj->exps);
+	obj->exps = NULL;
+}
+
+/*
+ * Returns 0 if the expression could not be compiled, in which case the
+ * caller needs to evaluate it with the parser.
+ */
+
+static uint8_t prv_rpn_eval_from_id_e(salink_obj_t *obj, unsigned int line_no,
+				      uint8_t id, uint8_t lng, const char *str,
+				      int16_t *exp)
+{
+	struct salink_rpn_t_ **slot;
+
+	slot = prv_rpn_slot(obj, id, lng);
+	if (!slot)
+		return 0;
+
+	if (!*slot) {
+		*slot = prv_rpn_compile(str);
+		if (!*slot)
+			return 0;
+	}
+
+	*exp = prv_rpn_eval_e(*slot, line_no);
+
+	return 1;
+}
+#endif
+
 static int16_t prv_eval_exp_from_id_e(salink_obj_t *obj, unsigned int line_no,
 				      uint8_t id, uint8_t lng)
 {
@@ -778,7 +1383,12 @@ static int16_t prv_eval_exp_from_id_e(salink_obj_t *obj, unsigned int line_no,
 		return 0;
 
 	g_obj = obj;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (!prv_rpn_eval_from_id_e(obj, line_no, id, lng, str, &exp))
+		exp = prv_equ_eval_e(str, 0, 0, line_no);
+#else
 	exp = prv_equ_eval_e(str, 0, 0, line_no);
+#endif
 	prv_check_exp_err(str, line_no, 1);
 
 	if ((err_type != SPECASM_ERROR_OK) && (err_type < SPECASM_MAX_ERRORS)) {
@@ -834,7 +1444,7 @@ static void prv_eval_equ_16bit_e(specasm_line_t *line, salink_obj_t *obj,
 
 #ifdef SPECASM_TARGET_NEXT_OPCODES
 static void prv_eval_equ_push_imm_e(specasm_line_t *line, salink_obj_t *obj,
-				    unsigned int line_no)
+				    unsigned int line_no, uint8_t loc)
 {
 	int16_t exp;
 	uint8_t exp_rev[2];
@@ -849,7 +1459,7 @@ static void prv_eval_equ_push_imm_e(specasm_line_t *line, salink_obj_t *obj,
 	 * expression.
 	 */
 
-	exp = prv_eval_equ_label(line, obj, line_no, line->data.op_code[3]);
+	exp = prv_eval_equ_label(line, obj, line_no, line->data.op_code[loc]);
 	if (err_type != SPECASM_ERROR_OK)
 		return;
 	memcpy(exp_rev, &exp, 2);
@@ -858,6 +1468,44 @@ static void prv_eval_equ_push_imm_e(specasm_line_t *line, salink_obj_t *obj,
 }
 #endif
 
+/*
+ * Returns the index in op_code of the id of the expression used by line.
+ * type is the type of the line without SPECASM_LINE_TYPE_EXP_ADJ.
+ */
+
+static uint8_t prv_exp_loc(const specasm_line_t *line, uint8_t type)
+{
+	uint8_t opcode0 = line->data.op_code[0];
+
+	switch (type) {
+#ifdef SPECASM_TARGET_NEXT_OPCODES
+	case SPECASM_LINE_TYPE_ADD:
+		return (opcode0 == 0xED) ? 2 : 1;
+	case SPECASM_LINE_TYPE_TEST:
+	case SPECASM_LINE_TYPE_NEXTREG:
+		return 2;
+	case SPECASM_LINE_TYPE_PUSH:
+		return 3;
+#endif
+	case SPECASM_LINE_TYPE_LD:
+		if ((opcode0 & 0xC7) == 0x6)
+			return 1;
+		if ((opcode0 == 0xDD) || (opcode0 == 0xFD))
+			return (line->data.op_code[1] == 0x36) ? 3 : 2;
+		return (opcode0 == 0xED) ? 2 : 1;
+	case SPECASM_LINE_TYPE_BIT:
+	case SPECASM_LINE_TYPE_RES:
+	case SPECASM_LINE_TYPE_SET:
+	case SPECASM_LINE_TYPE_IM:
+		return 2;
+	case SPECASM_LINE_TYPE_DB:
+	case SPECASM_LINE_TYPE_DW:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
 #ifdef SPECASM_NEXT_BANKED
 void salink_apply_expressions_banked_e(specasm_line_t *line, salink_obj_t *obj,
 				       unsigned int line_no)
@@ -868,8 +1516,10 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 {
 	int16_t exp;
 	uint8_t opcode0;
+	uint8_t loc;
 
 	line->type -= SPECASM_LINE_TYPE_EXP_ADJ;
+	loc = prv_exp_loc(line, line->type);
 
 	switch (line->type) {
 	case SPECASM_LINE_TYPE_ADC:
@@ -883,18 +1533,16 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 	case SPECASM_LINE_TYPE_SUB:
 	case SPECASM_LINE_TYPE_XOR:
 #ifdef SPECASM_TARGET_NEXT_OPCODES
-		if ((line->type == SPECASM_LINE_TYPE_ADD) &&
-		    (line->data.op_code[0] == 0xED))
-			prv_eval_equ_16bit_e(line, obj, line_no, 2);
-		else
-			prv_eval_equ_8bit_e(line, obj, line_no, 1);
-#else
-		prv_eval_equ_8bit_e(line, obj, line_no, 1);
+		if (loc == 2) {
+			prv_eval_equ_16bit_e(line, obj, line_no, loc);
+			break;
+		}
 #endif
+		prv_eval_equ_8bit_e(line, obj, line_no, loc);
 		break;
 	case SPECASM_LINE_TYPE_RST:
 		exp = prv_eval_equ_label(line, obj, line_no,
-					 line->data.op_code[1]);
+					 line->data.op_code[loc]);
 		if (err_type != SPECASM_ERROR_OK)
 			return;
 		if ((exp > 0x38) || (exp & 7)) {
@@ -908,8 +1556,8 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 		break;
 	case SPECASM_LINE_TYPE_LD:
 		opcode0 = line->data.op_code[0];
-		if ((opcode0 & 0xC7) == 0x6) {
-			prv_eval_equ_8bit_e(line, obj, line_no, 1);
+		if (((opcode0 & 0xC7) == 0x6) || (loc == 3)) {
+			prv_eval_equ_8bit_e(line, obj, line_no, loc);
 			break;
 		}
 		switch (opcode0) {
@@ -921,16 +1569,10 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 		case 0x3a:
 		case 0x22:
 		case 0x32:
-			prv_eval_equ_16bit_e(line, obj, line_no, 1);
-			break;
 		case 0xDD:
 		case 0xFD:
-			if (line->data.op_code[1] == 0x36) {
-				prv_eval_equ_8bit_e(line, obj, line_no, 3);
-				break;
-			}
 		case 0xED:
-			prv_eval_equ_16bit_e(line, obj, line_no, 2);
+			prv_eval_equ_16bit_e(line, obj, line_no, loc);
 			break;
 		}
 		break;
@@ -938,7 +1580,7 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 	case SPECASM_LINE_TYPE_RES:
 	case SPECASM_LINE_TYPE_SET:
 		exp = prv_eval_equ_label(line, obj, line_no,
-					 line->data.op_code[2]);
+					 line->data.op_code[loc]);
 		if (err_type != SPECASM_ERROR_OK)
 			return;
 		if (exp > 7) {
@@ -952,7 +1594,7 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 		break;
 	case SPECASM_LINE_TYPE_IM:
 		exp = prv_eval_equ_label(line, obj, line_no,
-					 line->data.op_code[2]);
+					 line->data.op_code[loc]);
 		if (err_type != SPECASM_ERROR_OK)
 			return;
 		if (exp > 2) {
@@ -969,21 +1611,19 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 		break;
 	case SPECASM_LINE_TYPE_CALL:
 	case SPECASM_LINE_TYPE_JP:
-		prv_eval_equ_16bit_e(line, obj, line_no, 1);
+	case SPECASM_LINE_TYPE_DW:
+		prv_eval_equ_16bit_e(line, obj, line_no, loc);
 		break;
 	case SPECASM_LINE_TYPE_DB:
-		prv_eval_equ_8bit_e(line, obj, line_no, 0);
-		break;
-	case SPECASM_LINE_TYPE_DW:
-		prv_eval_equ_16bit_e(line, obj, line_no, 0);
+		prv_eval_equ_8bit_e(line, obj, line_no, loc);
 		break;
 #ifdef SPECASM_TARGET_NEXT_OPCODES
 	case SPECASM_LINE_TYPE_TEST:
 	case SPECASM_LINE_TYPE_NEXTREG:
-		prv_eval_equ_8bit_e(line, obj, line_no, 2);
+		prv_eval_equ_8bit_e(line, obj, line_no, loc);
 		break;
 	case SPECASM_LINE_TYPE_PUSH:
-		prv_eval_equ_push_imm_e(line, obj, line_no);
+		prv_eval_equ_push_imm_e(line, obj, line_no, loc);
 		break;
 #endif
 	default:
@@ -995,3 +1635,17 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 
 	specasm_line_set_addr_type(line, SPECASM_FLAGS_ADDR_NUM);
 }
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+const char *salink_get_expression_str_e(const specasm_line_t *line)
+{
+	uint8_t type = line->type - SPECASM_LINE_TYPE_EXP_ADJ;
+	uint8_t loc = prv_exp_loc(line, type);
+	uint8_t lng = specasm_line_get_addr_type(line) ==
+			      SPECASM_FLAGS_ADDR_SHORT
+			  ? 0
+			  : 1;
+
+	return salink_get_label_str_e(line->data.op_code[loc], lng);
+}
+#endif
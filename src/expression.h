@@ -26,4 +26,22 @@ void salink_apply_expressions_e(specasm_line_t *line, salink_obj_t *obj,
 void salink_equ_eval_global_e(salink_obj_t *obj, salink_global_t *global,
 			      salink_label_t *label, uint8_t depth);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Returns the expression used by line, whose type must be at least
+ * SPECASM_LINE_TYPE_EXP_ADJ.  The expression is located in the same way
+ * as it is by salink_apply_expressions_e(), which line must not have
+ * been passed to.
+ */
+
+const char *salink_get_expression_str_e(const specasm_line_t *line);
+
+/*
+ * Frees the compiled expressions cached by obj.
+ */
+
+void salink_free_expressions(salink_obj_t *obj);
+#endif
+
 #endif
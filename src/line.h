@@ -353,6 +353,18 @@ uint8_t specasm_parse_mnemomic_e(const char *str, uint8_t i,
 				 specasm_line_t *line);
 uint8_t specasm_parse_exp_e(const char *str, uint8_t *label1,
 			    uint8_t *label1_type);
+
+/*
+ * On the host, if the instruction in str contains an expression that
+ * doesn't refer to any labels or characters, specasm_fold_exp() writes a
+ * copy of str to folded, in which the expression is replaced by its value,
+ * and returns 1.  folded must be able to hold SPECASM_LINE_MAX_LEN + 1
+ * characters.  0 is returned if the expression can't be folded.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+uint8_t specasm_fold_exp(const char *str, char *folded);
+#endif
 uint8_t specasm_dump_opcode_e(const specasm_line_t *line, char *buf);
 uint8_t specasm_dump_byte(char *buf, uint8_t v, uint8_t flags);
 uint8_t specasm_dump_word(char *buf, uint16_t v, uint8_t flags);
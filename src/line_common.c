@@ -14,6 +14,8 @@
  * limitations under the License.
 */
 
+#include <string.h>
+
 #include "line_common.h"
 
 /* clang-format off */
@@ -138,7 +140,77 @@ const specasm_mnemomic_t mnemomics_table[] = {
 	{ "zx81", SPECASM_LINE_TYPE_ZX81, },
 };
 
+/*
+ * A perfect hash of the mnemomics in mnemomics_table.  See
+ * specasm_find_mnemomic().  mnemomics_hash holds 1 + the index of the
+ * mnemomic in mnemomics_table, or 0 for an empty slot.
+ *
+ * The tables are generated by mnemomic_hash.sh, which hashes each
+ * mnemomic into its bucket and then, taking the buckets with the most
+ * mnemomics first, chooses the smallest displacement that moves each
+ * mnemomic in the bucket into a free slot.  Run make mnemomic_hash to
+ * rebuild them whenever a mnemomic is added.
+ */
+
+/* Begin generated by mnemomic_hash.sh.  Do not edit. */
+#ifdef SPECASM_TARGET_NEXT_OPCODES
+const uint8_t mnemomics_disp[SPECASM_MNEMOMIC_BUCKETS] = {
+	12, 19, 0, 0, 20, 2, 5, 8,
+	0, 1, 9, 2, 0, 1, 7, 0,
+	21, 8, 20, 3, 4, 9, 5, 16,
+	0, 0, 1, 4, 0, 19, 1, 5,
+};
+
+const uint8_t mnemomics_hash[SPECASM_MNEMOMIC_SLOTS] = {
+	52, 72, 41, 6, 45, 71, 51, 39, 87, 57, 47, 54, 63, 78, 53, 0,
+	0, 49, 12, 0, 29, 70, 56, 0, 0, 92, 77, 15, 69, 0, 74, 16,
+	82, 83, 79, 11, 18, 7, 17, 42, 80, 34, 81, 8, 9, 75, 10, 14,
+	0, 84, 85, 66, 65, 86, 21, 19, 0, 0, 58, 0, 0, 61, 0, 0,
+	23, 36, 0, 0, 0, 44, 59, 89, 88, 40, 90, 0, 60, 0, 91, 1,
+	2, 46, 0, 93, 0, 0, 0, 64, 0, 67, 0, 0, 4, 0, 76, 0,
+	0, 0, 0, 0, 95, 50, 0, 68, 0, 94, 32, 22, 13, 33, 25, 20,
+	38, 37, 26, 3, 30, 28, 35, 48, 62, 73, 24, 5, 55, 43, 27, 31,
+};
+#else
+const uint8_t mnemomics_disp[SPECASM_MNEMOMIC_BUCKETS] = {
+	12, 13, 0, 0, 6, 5, 1, 6,
+	0, 1, 5, 0, 0, 0, 12, 0,
+	11, 0, 0, 9, 4, 16, 4, 5,
+	0, 0, 5, 3, 0, 16, 2, 3,
+};
+
+const uint8_t mnemomics_hash[SPECASM_MNEMOMIC_SLOTS] = {
+	0, 54, 38, 42, 0, 53, 48, 0, 0, 0, 0, 0, 0, 0, 0, 40,
+	0, 0, 7, 52, 24, 41, 0, 0, 51, 0, 59, 10, 56, 0, 0, 11,
+	64, 65, 13, 6, 9, 61, 62, 57, 29, 0, 63, 12, 0, 31, 0, 0,
+	0, 66, 67, 14, 0, 68, 16, 0, 0, 0, 43, 0, 0, 46, 0, 18,
+	0, 0, 71, 70, 0, 37, 44, 0, 69, 35, 72, 0, 0, 45, 0, 1,
+	2, 0, 0, 0, 0, 0, 0, 0, 0, 49, 0, 0, 0, 0, 58, 0,
+	0, 0, 4, 74, 0, 0, 39, 50, 0, 73, 17, 15, 28, 20, 27, 19,
+	33, 3, 8, 25, 26, 32, 30, 21, 47, 5, 55, 22, 23, 34, 36, 60,
+};
+#endif
+/* End generated by mnemomic_hash.sh. */
+
 /* clang-format on */
 
 const uint8_t mnemomics_table_size =
     sizeof(mnemomics_table) / sizeof(const specasm_mnemomic_t);
+
+uint8_t specasm_find_mnemomic(const char *mnemomic)
+{
+	const char *ptr;
+	uint8_t index;
+	uint16_t hash = 0;
+
+	for (ptr = mnemomic; *ptr; ptr++)
+		hash = (hash << 5) + hash + (uint8_t)*ptr;
+
+	index = mnemomics_disp[hash & (SPECASM_MNEMOMIC_BUCKETS - 1)];
+	index = mnemomics_hash[((hash >> 5) + index) &
+			       (SPECASM_MNEMOMIC_SLOTS - 1)];
+	if (!index || strcmp(mnemomics_table[--index].mnemomic, mnemomic))
+		return SPECASM_MNEMOMIC_NONE;
+
+	return index;
+}
@@ -78,4 +78,22 @@ typedef struct specasm_mnemomic_t_ specasm_mnemomic_t;
 extern const specasm_mnemomic_t mnemomics_table[];
 extern const uint8_t mnemomics_table_size;
 
+/*
+ * Returns the index of mnemomic in mnemomics_table, or
+ * SPECASM_MNEMOMIC_NONE if it isn't a mnemomic.  The mnemomic is hashed,
+ * x = x * 33 + c, over its characters.  The bottom 5 bits of the hash
+ * select a displacement from mnemomics_disp that's added to the rest of
+ * the hash to give the mnemomic's slot in mnemomics_hash.  A single
+ * compare then confirms the match.
+ */
+
+#define SPECASM_MNEMOMIC_NONE 0xff
+#define SPECASM_MNEMOMIC_BUCKETS 32
+#define SPECASM_MNEMOMIC_SLOTS 128
+
+extern const uint8_t mnemomics_disp[SPECASM_MNEMOMIC_BUCKETS];
+extern const uint8_t mnemomics_hash[SPECASM_MNEMOMIC_SLOTS];
+
+uint8_t specasm_find_mnemomic(const char *mnemomic);
+
 #endif
@@ -14,6 +14,9 @@
  * limitations under the License.
 */
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include <stdio.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
 
@@ -1536,9 +1539,6 @@ static const specasm_opcode_t opcode_table[] = {
 
 /* clang-format on */
 
-static const uint8_t opcode_table_size =
-    sizeof(opcode_table) / sizeof(specasm_opcode_t);
-
 uint8_t specasm_parse_exp_e(const char *str, uint8_t *label1,
 			    uint8_t *label1_type)
 {
@@ -1594,6 +1594,249 @@ uint8_t specasm_parse_exp_e(const char *str, uint8_t *label1,
 	return end + 1;
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * A small evaluator for expressions that contain only numbers.  It
+ * follows the rules used by salink when it evaluates expressions, so the
+ * operators have the same priorities, unary operators apply to the whole
+ * expression that follows them and all arithmetic is performed on 16 bit
+ * signed integers.  Anything it doesn't understand, including labels and
+ * characters, causes it to fail, in which case the expression is left to
+ * salink.
+ */
+
+static const char *prv_fold_priority4(const char *str, int16_t *e);
+
+static const char *prv_fold_skip(const char *str)
+{
+	while (*str == ' ')
+		str++;
+	return str;
+}
+
+static const char *prv_fold_priority0(const char *str, int16_t *e)
+{
+	char *end_ptr;
+	long lval;
+	char c;
+
+	str = prv_fold_skip(str);
+	c = *str;
+
+	if ((c == '$') || ((c >= '0') && (c <= '9'))) {
+		if (c == '$')
+			str++;
+		lval = strtol(str, &end_ptr, c == '$' ? 16 : 10);
+		if ((end_ptr == str) || (lval > 0xffff) || (lval < -32768))
+			return NULL;
+		*e = (int16_t)lval;
+		return end_ptr;
+	}
+
+	if ((c != '-') && (c != '~') && (c != '('))
+		return NULL;
+
+	str = prv_fold_priority4(str + 1, e);
+	if (!str)
+		return NULL;
+
+	if (c == '-') {
+		*e = -*e;
+	} else if (c == '~') {
+		*e = ~*e;
+	} else {
+		str = prv_fold_skip(str);
+		if (*str != ')')
+			return NULL;
+		str++;
+	}
+
+	return str;
+}
+
+static const char *prv_fold_priority1(const char *str, int16_t *e)
+{
+	int16_t e2;
+	char op;
+
+	str = prv_fold_priority0(str, e);
+	while (str) {
+		str = prv_fold_skip(str);
+		op = *str;
+		if ((op != '*') && (op != '/'))
+			break;
+		str = prv_fold_priority0(str + 1, &e2);
+		if (!str)
+			return NULL;
+		if (op == '*') {
+			*e = *e * e2;
+		} else {
+			if (e2 == 0)
+				return NULL;
+			*e = *e / e2;
+		}
+	}
+
+	return str;
+}
+
+static const char *prv_fold_priority2(const char *str, int16_t *e)
+{
+	int16_t e2;
+	char op;
+
+	str = prv_fold_priority1(str, e);
+	while (str) {
+		str = prv_fold_skip(str);
+		op = *str;
+		if ((op != '+') && (op != '-'))
+			break;
+		str = prv_fold_priority1(str + 1, &e2);
+		if (!str)
+			return NULL;
+		*e = (op == '+') ? *e + e2 : *e - e2;
+	}
+
+	return str;
+}
+
+static const char *prv_fold_priority3(const char *str, int16_t *e)
+{
+	int16_t e2;
+	char op;
+
+	str = prv_fold_priority2(str, e);
+	while (str) {
+		str = prv_fold_skip(str);
+		op = *str;
+		if (((op != '<') && (op != '>')) || (str[1] != op))
+			break;
+		str = prv_fold_priority2(str + 2, &e2);
+		if (!str || (e2 < 0) || (e2 > 15))
+			return NULL;
+		*e = (op == '<') ? *e << e2 : *e >> e2;
+	}
+
+	return str;
+}
+
+static const char *prv_fold_priority4(const char *str, int16_t *e)
+{
+	int16_t e2;
+	char op;
+
+	str = prv_fold_priority3(str, e);
+	while (str) {
+		str = prv_fold_skip(str);
+		op = *str;
+		if ((op != '&') && (op != '|') && (op != '^'))
+			break;
+		str = prv_fold_priority3(str + 1, &e2);
+		if (!str)
+			return NULL;
+		if (op == '&')
+			*e = *e & e2;
+		else if (op == '|')
+			*e = *e | e2;
+		else
+			*e = *e ^ e2;
+	}
+
+	return str;
+}
+
+uint8_t specasm_fold_exp(const char *str, char *folded)
+{
+	uint8_t i;
+	uint8_t start;
+	uint8_t end;
+	uint8_t last;
+	uint8_t brackets = 0;
+	char exp[SPECASM_LINE_MAX_LEN + 1];
+	char num[8];
+	const char *rest;
+	int16_t e;
+	int len;
+	char c;
+
+	for (i = 0; (i < SPECASM_LINE_MAX_LEN) && str[i] && (str[i] <= ' ');
+	     i++)
+		;
+	if ((i == SPECASM_LINE_MAX_LEN) || !str[i] ||
+	    strchr(".;\"'@#+-!", str[i]))
+		return 0;
+
+	/*
+	 * Find the '=' that introduces the expression, skipping over any
+	 * character literals and stopping at the comment.
+	 */
+
+	for (; (i < SPECASM_LINE_MAX_LEN) && str[i] && (str[i] != '=');
+	     i++) {
+		if (str[i] == ';')
+			return 0;
+		if ((str[i] == '\'') && (i + 2 < SPECASM_LINE_MAX_LEN) &&
+		    (str[i + 2] == '\''))
+			i += 2;
+	}
+	if ((i == SPECASM_LINE_MAX_LEN) || (str[i] != '='))
+		return 0;
+
+	/*
+	 * The end of the expression is found in the same way as in
+	 * specasm_parse_exp_e().
+	 */
+
+	for (start = i + 1; (start < SPECASM_LINE_MAX_LEN) && str[start] == ' ';
+	     start++)
+		;
+	for (end = start; (end < SPECASM_LINE_MAX_LEN) && str[end]; end++) {
+		c = str[end];
+		if ((c == ',') || (c == ';'))
+			break;
+		if (c == ')') {
+			if (brackets == 0)
+				break;
+			brackets--;
+		} else if (c == '(') {
+			brackets++;
+		}
+	}
+	if ((start == end) || brackets)
+		return 0;
+
+	memcpy(exp, &str[start], end - start);
+	exp[end - start] = 0;
+
+	rest = prv_fold_priority4(exp, &e);
+	if (!rest || *prv_fold_skip(rest))
+		return 0;
+
+	if (e < 0)
+		len = snprintf(num, sizeof(num), "%d", e);
+	else if (strchr(exp, '$'))
+		len = snprintf(num, sizeof(num), "$%x", e);
+	else
+		len = snprintf(num, sizeof(num), "%d", e);
+
+	for (last = end; (last < SPECASM_LINE_MAX_LEN) && str[last]; last++)
+		;
+	while ((last > end) && (str[last - 1] == ' '))
+		last--;
+	if (i + len + (last - end) > SPECASM_LINE_MAX_LEN)
+		return 0;
+
+	memset(folded, ' ', SPECASM_LINE_MAX_LEN);
+	folded[SPECASM_LINE_MAX_LEN] = 0;
+	memcpy(folded, str, i);
+	memcpy(&folded[i], num, len);
+	memcpy(&folded[i + len], &str[end], last - end);
+
+	return 1;
+}
+#endif
+
 #if defined(SPECASM_NEXT_BANKED) || defined(SPECASM_128_BANKED)
 uint8_t specasm_parse_mnemomic_banked_e(const char *str, uint8_t i,
 					specasm_line_t *line)
@@ -1603,9 +1846,6 @@ uint8_t specasm_parse_mnemomic_e(const char *str, uint8_t i,
 #endif
 {
 	uint8_t m;
-	uint8_t l;
-	uint8_t r;
-	int res;
 	const specasm_opcode_t *op_entry;
 	char buf[SPECASM_MAX_MNEMOM + 1];
 	uint8_t j = 0;
@@ -1614,37 +1854,26 @@ uint8_t specasm_parse_mnemomic_e(const char *str, uint8_t i,
 		buf[j] = str[i];
 	buf[j] = 0;
 
-	l = 0;
-	r = opcode_table_size - 1;
+	m = specasm_find_mnemomic(buf);
+	if (m == SPECASM_MNEMOMIC_NONE) {
+		err_type = SPECASM_ERROR_BAD_MNENOMIC;
+		return 0xff;
+	}
 
-	while (l <= r) {
-		m = (l + r) >> 1;
-		res = strcmp(mnemomics_table[m].mnemomic, buf);
-		if (res < 0) {
-			l = m + 1;
-		} else if (res > 0) {
-			if (m == 0)
-				break;
-			r = m - 1;
-		} else {
-			op_entry = &opcode_table[m];
-			line->type = mnemomics_table[m].line_type;
-			line->flags = 0;
-			memset(&line->data, 0, sizeof(line->data));
-			if (!op_entry->fn) {
-				line->data.op_code[0] = op_entry->op_code[0];
-				line->data.op_code[1] = op_entry->op_code[1];
-				if (line->data.op_code[0]) {
-					if (line->data.op_code[1])
-						line->flags++;
-				}
-			} else {
-				i += op_entry->fn(str + i, line, op_entry);
-			}
-			return i;
+	op_entry = &opcode_table[m];
+	line->type = mnemomics_table[m].line_type;
+	line->flags = 0;
+	memset(&line->data, 0, sizeof(line->data));
+	if (!op_entry->fn) {
+		line->data.op_code[0] = op_entry->op_code[0];
+		line->data.op_code[1] = op_entry->op_code[1];
+		if (line->data.op_code[0]) {
+			if (line->data.op_code[1])
+				line->flags++;
 		}
+	} else {
+		i += op_entry->fn(str + i, line, op_entry);
 	}
 
-	err_type = SPECASM_ERROR_BAD_MNENOMIC;
-	return 0xff;
+	return i;
 }
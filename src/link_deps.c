@@ -0,0 +1,144 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_deps.h"
+#include "salink.h"
+
+static char **deps;
+static unsigned int dep_count;
+static unsigned int dep_max;
+
+void salink_deps_add_e(const char *fname)
+{
+	char **new_deps;
+	unsigned int new_max;
+	size_t len = strlen(fname);
+	const char *open;
+	char *dep;
+
+	if (!(link_flags & SALINK_FLAG_DEPS))
+		return;
+
+	open = strrchr(fname, '(');
+	if (open && len && (fname[len - 1] == ')'))
+		len = open - fname;
+
+	if (dep_count == dep_max) {
+		new_max = dep_max ? dep_max * 2 : 64;
+		new_deps = realloc(deps, new_max * sizeof(*deps));
+		if (!new_deps)
+			goto on_error;
+		deps = new_deps;
+		dep_max = new_max;
+	}
+
+	dep = malloc(len + 1);
+	if (!dep)
+		goto on_error;
+	memcpy(dep, fname, len);
+	dep[len] = 0;
+	deps[dep_count++] = dep;
+
+	return;
+
+on_error:
+
+	strcpy(error_buf, "Out of memory");
+	err_type = SALINK_ERROR_NO_MEMORY;
+}
+
+static int prv_dep_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Spaces, hashes, colons and dollars need to be escaped if make is to
+ * read the names back correctly.
+ */
+
+static void prv_write_name(FILE *f, const char *name)
+{
+	for (; *name; name++) {
+		if ((*name == ' ') || (*name == '#') || (*name == ':'))
+			fputc('\\', f);
+		else if (*name == '$')
+			fputc('$', f);
+		fputc(*name, f);
+	}
+}
+
+void salink_deps_write_e(const char *target, const char *fname,
+			 uint8_t append)
+{
+	FILE *f;
+	unsigned int i;
+	unsigned int unique = 0;
+
+	qsort(deps, dep_count, sizeof(*deps), prv_dep_cmp);
+	for (i = 0; i < dep_count; i++) {
+		if (unique && !strcmp(deps[unique - 1], deps[i])) {
+			free(deps[i]);
+			continue;
+		}
+		deps[unique++] = deps[i];
+	}
+	dep_count = unique;
+
+	f = fopen(fname, append ? "a" : "w");
+	if (!f) {
+		snprintf(error_buf, sizeof(error_buf), "Can't open %s", fname);
+		err_type = SALINK_ERROR_CANT_OPEN;
+		return;
+	}
+
+	if (append)
+		fputc('\n', f);
+	prv_write_name(f, target);
+	fputc(':', f);
+	for (i = 0; i < dep_count; i++) {
+		fputs(" \\\n ", f);
+		prv_write_name(f, deps[i]);
+	}
+	fputc('\n', f);
+	for (i = 0; i < dep_count; i++) {
+		fputc('\n', f);
+		prv_write_name(f, deps[i]);
+		fputs(":\n", f);
+	}
+
+	if (fclose(f)) {
+		snprintf(error_buf, sizeof(error_buf), "Can't write %s",
+			 fname);
+		err_type = SALINK_ERROR_CANT_OPEN;
+	}
+}
+
+void salink_deps_reset(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < dep_count; i++)
+		free(deps[i]);
+	free(deps);
+	deps = NULL;
+	dep_count = 0;
+	dep_max = 0;
+}
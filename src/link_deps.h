@@ -0,0 +1,41 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_DEPS_H
+#define LINK_DEPS_H
+
+#include <stdint.h>
+
+/*
+ * Host only.  When SALINK_FLAG_DEPS is set, salink records the object
+ * files, libraries, included directories and binary files that each
+ * image is built from and writes them out as a make rule.
+ *
+ * salink_deps_add_e() records a single dependency.  Objects stored in a
+ * library are recorded as the library itself.  Duplicates are removed
+ * when the rule is written.
+ *
+ * salink_deps_write_e() writes a rule for target, followed by an empty
+ * rule for each dependency so that make doesn't fail when one of them is
+ * deleted.  The rule is appended to fname if append is set.
+ */
+
+void salink_deps_add_e(const char *fname);
+void salink_deps_write_e(const char *target, const char *fname,
+			 uint8_t append);
+void salink_deps_reset(void);
+
+#endif
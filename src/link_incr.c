@@ -0,0 +1,376 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_incr.h"
+
+/*
+ * The state file contains a header, followed by a record for each object
+ * in the binary, in the order they were written, followed by the value,
+ * the length of the name and the name of each global.  It's only ever
+ * read back by the salink that wrote it so the records are stored in
+ * the host's byte order.
+ *
+ * image_hash is used to check that the binary hasn't been rebuilt, or
+ * modified, since the state file was written.
+ */
+
+#define SALINK_INCR_MAGIC 0x4b4c4153u
+#define SALINK_INCR_VERSION 1
+#define SALINK_INCR_FLAG_ZX81 0x80
+
+struct prv_incr_header_t_ {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t start;
+	uint32_t flags;
+	uint32_t obj_count;
+	uint32_t global_count;
+	uint32_t image_size;
+	uint64_t image_hash;
+};
+typedef struct prv_incr_header_t_ prv_incr_header_t;
+
+struct prv_incr_obj_t_ {
+	uint64_t hash;
+	uint16_t addr;
+	uint16_t size;
+	char fname[MAX_FNAME + 1];
+};
+typedef struct prv_incr_obj_t_ prv_incr_obj_t;
+
+/*
+ * reuse is indexed by position in the link order and points to the bytes
+ * in image that can be copied for the object at that position.
+ */
+
+struct prv_incr_reuse_t_ {
+	const uint8_t *data;
+	uint16_t size;
+};
+typedef struct prv_incr_reuse_t_ prv_incr_reuse_t;
+
+static prv_incr_header_t header;
+static prv_incr_obj_t *objs;
+static prv_incr_reuse_t *reuse;
+static uint8_t *image;
+static unsigned int reused;
+
+static uint64_t prv_hash(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *ptr = data;
+
+	while (len--) {
+		hash ^= *ptr++;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+/*
+ * Returns 0 if the object's bytes can't be reused.
+ */
+
+static uint64_t prv_hash_obj(const salink_obj_t *obj)
+{
+	const specasm_state_t *st = obj->state;
+	uint64_t hash = 14695981039346656037ull;
+	uint16_t i;
+	uint8_t type;
+
+	if (!st)
+		return 0;
+
+	for (i = 0; i < st->lines.num_lines; i++) {
+		type = st->lines.lines[i].type;
+		if ((type == SPECASM_LINE_TYPE_INC_BIN_SHORT) ||
+		    (type == SPECASM_LINE_TYPE_INC_BIN_LONG))
+			return 0;
+	}
+
+	hash = prv_hash(hash, st->lines.lines,
+			st->lines.num_lines * sizeof(specasm_line_t));
+	hash = prv_hash(hash, st->short_strs.strs,
+			st->short_strs.num_strings * SPECASM_MAX_SHORT_LEN);
+	hash = prv_hash(hash, st->long_strs.strs,
+			st->long_strs.num_strings * SPECASM_MAX_LONG_LEN);
+
+	return hash ? hash : 1;
+}
+
+static uint8_t prv_globals_match(FILE *f)
+{
+	unsigned int i;
+	uint16_t value;
+	uint8_t len;
+	salink_global_t *global;
+	char name[SPECASM_LINE_MAX_LEN + 1];
+
+	for (i = 0; i < global_count; i++) {
+		global = &globals[i];
+		if ((fread(&value, sizeof(value), 1, f) != 1) ||
+		    (fread(&len, sizeof(len), 1, f) != 1) ||
+		    (len > SPECASM_LINE_MAX_LEN) ||
+		    (fread(name, 1, len, f) != len))
+			return 0;
+		name[len] = 0;
+		if ((value != labels[global->label_index].data.off) ||
+		    strcmp(name, global->name))
+			return 0;
+	}
+
+	return 1;
+}
+
+static uint8_t *prv_read_image(const char *image_fname,
+			       const prv_incr_header_t *old)
+{
+	FILE *f;
+	uint8_t *data;
+	uint64_t hash = 14695981039346656037ull;
+
+	f = fopen(image_fname, "rb");
+	if (!f)
+		return NULL;
+
+	data = malloc(old->image_size + 1);
+	if (!data)
+		goto on_error;
+
+	if ((fread(data, 1, old->image_size, f) != old->image_size) ||
+	    (fgetc(f) != EOF))
+		goto on_error;
+
+	hash = prv_hash(hash, data, old->image_size);
+	if (hash != old->image_hash)
+		goto on_error;
+
+	fclose(f);
+
+	return data;
+
+on_error:
+
+	free(data);
+	fclose(f);
+
+	return NULL;
+}
+
+/*
+ * Marks the objects whose bytes can be copied from the previous binary.
+ * Any problem with the state file or the binary simply means that
+ * nothing is reused.
+ */
+
+static void prv_load_previous(const salink_obj_index_t *order,
+			      const char *image_fname, const char *state_fname)
+{
+	FILE *f;
+	unsigned int i;
+	unsigned int j = 0;
+	prv_incr_header_t old;
+	prv_incr_obj_t *cur;
+	prv_incr_obj_t *prev;
+	prv_incr_obj_t *old_objs = NULL;
+
+	f = fopen(state_fname, "rb");
+	if (!f)
+		return;
+
+	if ((fread(&old, sizeof(old), 1, f) != 1) ||
+	    (old.magic != header.magic) || (old.version != header.version) ||
+	    (old.start != header.start) || (old.flags != header.flags) ||
+	    (old.obj_count != header.obj_count) ||
+	    (old.global_count != header.global_count))
+		goto cleanup;
+
+	old_objs = malloc((old.obj_count + 1) * sizeof(*old_objs));
+	if (!old_objs)
+		goto cleanup;
+	if ((fread(old_objs, sizeof(*old_objs), old.obj_count, f) !=
+	     old.obj_count) ||
+	    !prv_globals_match(f))
+		goto cleanup;
+
+	image = prv_read_image(image_fname, &old);
+	if (!image)
+		goto cleanup;
+
+	for (i = 0; i < obj_file_count; i++) {
+		if (salink_obj_excluded(&obj_files[order[i]]))
+			continue;
+		cur = &objs[j];
+		prev = &old_objs[j++];
+		if (!cur->hash || (cur->hash != prev->hash) ||
+		    (cur->addr != prev->addr) || (cur->size != prev->size) ||
+		    strcmp(cur->fname, prev->fname))
+			continue;
+		if (cur->addr - old.start + cur->size > old.image_size)
+			continue;
+		reuse[i].data = &image[cur->addr - old.start];
+		reuse[i].size = cur->size;
+		reused++;
+	}
+
+cleanup:
+	free(old_objs);
+	fclose(f);
+}
+
+void salink_incr_begin_e(const salink_obj_index_t *order, uint16_t start,
+			 const char *image_fname, const char *state_fname)
+{
+	unsigned int i;
+	unsigned int count = 0;
+	salink_obj_t *obj;
+	prv_incr_obj_t *cur;
+
+	salink_incr_free();
+
+	objs = calloc(obj_file_count + 1, sizeof(*objs));
+	reuse = calloc(obj_file_count + 1, sizeof(*reuse));
+	if (!objs || !reuse) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return;
+	}
+
+	for (i = 0; i < obj_file_count; i++) {
+		obj = &obj_files[order[i]];
+		if (salink_obj_excluded(obj))
+			continue;
+		cur = &objs[count++];
+		strcpy(cur->fname, obj->fname);
+		cur->addr = obj->addr;
+		cur->size = obj->end - obj->addr;
+		cur->hash = prv_hash_obj(obj);
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SALINK_INCR_MAGIC;
+	header.version = SALINK_INCR_VERSION;
+	header.start = start;
+	header.flags =
+	    link_flags & (SALINK_FLAG_RELAX | SALINK_FLAG_RELAX_SIZE);
+	if (got_zx81)
+		header.flags |= SALINK_INCR_FLAG_ZX81;
+	header.obj_count = count;
+	header.global_count = global_count;
+
+	prv_load_previous(order, image_fname, state_fname);
+}
+
+const uint8_t *salink_incr_find(unsigned int pos, uint16_t *size)
+{
+	if (!reuse || !reuse[pos].data)
+		return NULL;
+
+	*size = reuse[pos].size;
+
+	return reuse[pos].data;
+}
+
+void salink_incr_save_e(const char *state_fname, unsigned int image_size)
+{
+	FILE *f;
+	unsigned int i;
+	int failed;
+	uint8_t len;
+	uint16_t value;
+	salink_global_t *global;
+	uint8_t *data;
+
+	if (!objs)
+		return;
+
+	/*
+	 * The binary has already been closed so we hash it as it is on
+	 * disk.
+	 */
+
+	header.image_size = image_size;
+	data = malloc(image_size + 1);
+	if (!data) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return;
+	}
+	f = fopen(image_name, "rb");
+	failed = !f || (fread(data, 1, image_size, f) != image_size);
+	if (f)
+		fclose(f);
+	header.image_hash =
+	    prv_hash(14695981039346656037ull, data, image_size);
+	free(data);
+	if (failed) {
+		snprintf(error_buf, sizeof(error_buf), "Can't read %s",
+			 image_name);
+		err_type = SALINK_ERROR_CANT_OPEN;
+		return;
+	}
+
+	f = fopen(state_fname, "wb");
+	if (!f) {
+		snprintf(error_buf, sizeof(error_buf), "Can't open %s",
+			 state_fname);
+		err_type = SALINK_ERROR_CANT_OPEN;
+		return;
+	}
+
+	(void)fwrite(&header, sizeof(header), 1, f);
+	(void)fwrite(objs, sizeof(*objs), header.obj_count, f);
+	for (i = 0; i < global_count; i++) {
+		global = &globals[i];
+		value = labels[global->label_index].data.off;
+		len = strlen(global->name);
+		(void)fwrite(&value, sizeof(value), 1, f);
+		(void)fwrite(&len, sizeof(len), 1, f);
+		(void)fwrite(global->name, 1, len, f);
+	}
+
+	failed = ferror(f);
+	if (fclose(f) || failed) {
+		snprintf(error_buf, sizeof(error_buf), "Can't write %s",
+			 state_fname);
+		err_type = SALINK_ERROR_CANT_OPEN;
+	}
+}
+
+unsigned int salink_incr_reused(void)
+{
+	return reused;
+}
+
+unsigned int salink_incr_linked(void)
+{
+	return header.obj_count;
+}
+
+void salink_incr_free(void)
+{
+	free(image);
+	image = NULL;
+	free(reuse);
+	reuse = NULL;
+	free(objs);
+	objs = NULL;
+	reused = 0;
+}
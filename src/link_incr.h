@@ -0,0 +1,70 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_INCR_H
+#define LINK_INCR_H
+
+#include "salink.h"
+
+/*
+ * Host only.  Incremental linking.
+ *
+ * After a link the layout of the binary is saved to a state file: the
+ * address, size and a hash of the contents of each object and the values
+ * of all the globals.  When the next link lays the objects out at the
+ * same addresses and all the globals have the same values, the bytes of
+ * an object whose contents haven't changed can't have changed either, so
+ * they're copied from the previous binary rather than being generated
+ * again.  Objects that include binary files are always regenerated.
+ */
+
+/*
+ * Called once the objects have been laid out and the global EQUs
+ * evaluated, but before the previous binary, image_fname, is removed.
+ * order holds the order in which the objects are to be linked.  If
+ * state_fname describes an identical layout, the parts of the previous
+ * binary that can be reused are read into memory.
+ */
+
+void salink_incr_begin_e(const salink_obj_index_t *order, uint16_t start,
+			 const char *image_fname, const char *state_fname);
+
+/*
+ * Returns the bytes of the object at position pos in order if they can
+ * be copied from the previous binary, storing their number in *size,
+ * otherwise NULL.
+ */
+
+const uint8_t *salink_incr_find(unsigned int pos, uint16_t *size);
+
+/*
+ * Saves the layout of the binary just written, image_size bytes long,
+ * to state_fname.
+ */
+
+void salink_incr_save_e(const char *state_fname, unsigned int image_size);
+
+/*
+ * The number of objects copied from the previous binary and the number
+ * of objects linked.
+ */
+
+unsigned int salink_incr_reused(void);
+unsigned int salink_incr_linked(void);
+
+void salink_incr_free(void);
+
+#endif
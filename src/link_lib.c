@@ -0,0 +1,321 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_lib.h"
+#include "link_refs.h"
+#include "salib.h"
+
+struct salink_lib_t_ {
+	char fname[MAX_FNAME + 1];
+	salib_member_t *members;
+	uint16_t num_members;
+	uint32_t num_symbols;
+	char *index;
+	const char **symbols;
+};
+typedef struct salink_lib_t_ salink_lib_t;
+
+static salink_lib_t *libs;
+static unsigned int lib_count;
+static unsigned int queued_members;
+
+static const uint8_t lib_magic[SALIB_MAGIC_LEN] = SALIB_MAGIC;
+
+uint8_t salink_lib_check_fname(const char *fname)
+{
+	size_t len = strlen(fname);
+
+	return (len > 4) && (fname[len - 4] == '.') &&
+	       ((fname[len - 3] | 32) == 'l') &&
+	       ((fname[len - 2] | 32) == 'i') && ((fname[len - 1] | 32) == 'b');
+}
+
+static void prv_free_lib(salink_lib_t *lib)
+{
+	free(lib->members);
+	free(lib->index);
+	free(lib->symbols);
+}
+
+/*
+ * Each symbol points to the name in the index.  The index of the member
+ * that defines the symbol is stored in the two bytes that precede it.
+ */
+
+static uint8_t prv_build_symbols(salink_lib_t *lib, uint32_t index_size)
+{
+	uint32_t i;
+	uint32_t pos = 0;
+	uint16_t member;
+	const char *name;
+	const char *end;
+
+	for (i = 0; i < lib->num_symbols; i++) {
+		if (index_size - pos < sizeof(member) + 1)
+			return 0;
+		memcpy(&member, &lib->index[pos], sizeof(member));
+		if (member >= lib->num_members)
+			return 0;
+		pos += sizeof(member);
+		name = &lib->index[pos];
+		end = memchr(name, 0, index_size - pos);
+		if (!end)
+			return 0;
+		if ((i > 0) && (strcmp(lib->symbols[i - 1], name) >= 0))
+			return 0;
+		lib->symbols[i] = name;
+		pos += (end - name) + 1;
+	}
+
+	return pos == index_size;
+}
+
+static void prv_read_lib_e(salink_lib_t *lib)
+{
+	FILE *f;
+	salib_header_t hdr;
+	size_t members_size;
+	uint16_t i;
+
+	f = fopen(lib->fname, "r");
+	if (!f) {
+		snprintf(error_buf, sizeof(error_buf), "Can't open %s",
+			 lib->fname);
+		err_type = SALINK_ERROR_CANT_OPEN;
+		return;
+	}
+
+	if ((fread(&hdr, 1, sizeof(hdr), f) < sizeof(hdr)) ||
+	    memcmp(hdr.magic, lib_magic, SALIB_MAGIC_LEN) ||
+	    (hdr.version != SALIB_VERSION))
+		goto on_bad;
+
+	lib->num_members = hdr.num_members;
+	lib->num_symbols = hdr.num_symbols;
+	members_size = hdr.num_members * sizeof(*lib->members);
+	lib->members = malloc(members_size + 1);
+	lib->index = malloc(hdr.index_size + 1);
+	lib->symbols = malloc((hdr.num_symbols + 1) * sizeof(*lib->symbols));
+	if (!lib->members || !lib->index || !lib->symbols) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		goto cleanup;
+	}
+
+	if ((fread(lib->members, 1, members_size, f) < members_size) ||
+	    (fread(lib->index, 1, hdr.index_size, f) < hdr.index_size) ||
+	    !prv_build_symbols(lib, hdr.index_size))
+		goto on_bad;
+
+	for (i = 0; i < lib->num_members; i++)
+		if (lib->members[i].name[SALIB_MAX_MEMBER_NAME])
+			goto on_bad;
+
+	goto cleanup;
+
+on_bad:
+	snprintf(error_buf, sizeof(error_buf), "%s is not a library",
+		 lib->fname);
+	err_type = SALINK_ERROR_BAD_LIB;
+
+cleanup:
+	(void)fclose(f);
+}
+
+void salink_lib_add_e(const char *fname)
+{
+	unsigned int i;
+	salink_lib_t *new_libs;
+	salink_lib_t *lib;
+
+	for (i = 0; i < lib_count; i++)
+		if (!strcmp(libs[i].fname, fname))
+			return;
+
+	new_libs = realloc(libs, (lib_count + 1) * sizeof(*libs));
+	if (!new_libs) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return;
+	}
+	libs = new_libs;
+	lib = &libs[lib_count];
+	memset(lib, 0, sizeof(*lib));
+	strcpy(lib->fname, fname);
+
+	prv_read_lib_e(lib);
+	if (err_type != SPECASM_ERROR_OK) {
+		prv_free_lib(lib);
+		return;
+	}
+	lib_count++;
+}
+
+static salink_lib_t *prv_find_lib(const char *fname, size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < lib_count; i++)
+		if (!strncmp(libs[i].fname, fname, len) && !libs[i].fname[len])
+			return &libs[i];
+
+	return NULL;
+}
+
+void salink_lib_load_e(const char *fname)
+{
+	const char *open;
+	size_t len = strlen(fname);
+	salink_lib_t *lib;
+	salib_member_t *member;
+	uint16_t i;
+
+	open = strrchr(fname, '(');
+	if (!open || (fname[len - 1] != ')')) {
+		specasm_load_e(fname);
+		return;
+	}
+
+	lib = prv_find_lib(fname, open - fname);
+	if (!lib) {
+		err_type = SPECASM_ERROR_OPEN;
+		return;
+	}
+
+	open++;
+	len = (fname + len - 1) - open;
+	for (i = 0; i < lib->num_members; i++) {
+		member = &lib->members[i];
+		if (!strncmp(member->name, open, len) && !member->name[len]) {
+			specasm_load_at_e(lib->fname, member->offset);
+			return;
+		}
+	}
+
+	err_type = SPECASM_ERROR_OPEN;
+}
+
+static int prv_symbol_cmp(const void *a, const void *b)
+{
+	return strcmp((const char *)a, *(const char *const *)b);
+}
+
+static uint8_t prv_is_loaded(const char *fname)
+{
+	unsigned int i;
+
+	for (i = 0; i < obj_file_count; i++)
+		if (!strcmp(obj_files[i].fname, fname))
+			return 1;
+
+	for (i = 0; i < queued_files; i++)
+		if (!strcmp(salink_queued_fname(i), fname))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Queues the first member, from the libraries in the order in which
+ * they were included, that defines name, unless name is already defined.
+ */
+
+static void prv_queue_ref_e(const char *name)
+{
+	unsigned int i;
+	const char **sym = NULL;
+	uint16_t index;
+	salink_lib_t *lib;
+	char fname[MAX_FNAME + 1];
+
+	if (salink_find_global(name))
+		return;
+
+	for (i = 0; i < lib_count; i++) {
+		lib = &libs[i];
+		sym = bsearch(name, lib->symbols, lib->num_symbols,
+			      sizeof(*lib->symbols), prv_symbol_cmp);
+		if (sym)
+			break;
+	}
+	if (i == lib_count)
+		return;
+
+	memcpy(&index, *sym - sizeof(index), sizeof(index));
+	if (snprintf(fname, sizeof(fname), "%s(%s)", lib->fname,
+		     lib->members[index].name) >= (int)sizeof(fname)) {
+		snprintf(error_buf, sizeof(error_buf), "%s(%s) too long",
+			 lib->fname, lib->members[index].name);
+		err_type = SALINK_ERROR_BAD_LIB;
+		return;
+	}
+
+	if (prv_is_loaded(fname))
+		return;
+
+	salink_reserve_queued_files_e(queued_files + 1);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+	strcpy(salink_queued_fname(queued_files++), fname);
+	queued_members++;
+}
+
+/*
+ * The objects are scanned in the order in which they were parsed, so if
+ * no members are queued state is left holding the last object parsed,
+ * as it would have been had there been no libraries.
+ */
+
+unsigned int salink_lib_queue_members_e(void)
+{
+	unsigned int i;
+	uint16_t j;
+	salink_obj_t *obj;
+
+	if (lib_count == 0)
+		return 0;
+
+	queued_members = 0;
+	for (i = 0; i < obj_file_count; i++) {
+		obj = &obj_files[i];
+		salink_load_obj_e(obj);
+		if (err_type != SPECASM_ERROR_OK)
+			return 0;
+		for (j = 0; j < state.lines.num_lines; j++) {
+			salink_scan_line_refs_e(&state.lines.lines[j],
+						prv_queue_ref_e);
+			if (err_type != SPECASM_ERROR_OK)
+				return 0;
+		}
+	}
+
+	return queued_members;
+}
+
+void salink_lib_free(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < lib_count; i++)
+		prv_free_lib(&libs[i]);
+	free(libs);
+	libs = NULL;
+	lib_count = 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_LIB_H
+#define LINK_LIB_H
+
+#include "salink.h"
+
+/*
+ * Host only.  Libraries, created by salib, are included with the '-'
+ * and '+' directives, just like .x files and directories.  Including a
+ * library doesn't add any of its members to the link.  Once all the
+ * queued files have been parsed, salink_lib_queue_members_e() looks for
+ * globals that are used but not defined and queues the library members
+ * that define them.  This is repeated until no more members are needed.
+ *
+ * A library member is named lib(member), e.g., /specasm/lib/tst.lib(a.x),
+ * in obj_files and in error messages.
+ */
+
+uint8_t salink_lib_check_fname(const char *fname);
+void salink_lib_add_e(const char *fname);
+
+/*
+ * Loads fname, which may be a .x file or a library member, into state.
+ * Can be called from multiple threads.
+ */
+
+void salink_lib_load_e(const char *fname);
+
+/*
+ * Returns the number of members queued.
+ */
+
+unsigned int salink_lib_queue_members_e(void);
+void salink_lib_free(void);
+
+#endif
@@ -19,6 +19,16 @@
 #include <string.h>
 
 #include "expression.h"
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include "link_deps.h"
+#include "link_incr.h"
+#include "link_lib.h"
+#include "link_pack.h"
+#include "link_preload.h"
+#include "link_reach.h"
+#include "link_relax.h"
+#endif
+#include "link_stats.h"
 #include "map.h"
 #include "peer.h"
 #include "queued_files.h"
@@ -28,9 +38,31 @@
 static uint8_t got_org;
 static uint8_t map_file;
 static size_t label_count;
-static uint8_t main_index = 0xff;
+static salink_obj_index_t main_index = SALINK_NO_OBJ;
 static uint16_t start_address = 0x8000;
-static uint8_t obj_files_order[MAX_FILES];
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+static salink_obj_index_t *obj_files_order;
+static unsigned int obj_files_order_max;
+#else
+static salink_obj_index_t obj_files_order[MAX_FILES];
+#endif
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * In single pass mode we take a copy of the labels of the main binary
+ * before they are relocated.  The copy is restored when we start
+ * building the test binary.  At this point extending is set and only
+ * the .t files, and anything they include, are added.
+ */
+
+static salink_label_t *saved_labels;
+static size_t saved_label_count;
+static unsigned int pack_saved;
+static uint8_t extending;
+static unsigned int preloaded_files;
+static uint8_t deps_written;
+#endif
 
 static const char blank_field[] = "            ";
 
@@ -54,6 +86,11 @@ static uint8_t prv_check_file(const char *fname)
 		return is_x_file;
 	}
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (extending)
+		return is_test_file;
+#endif
+
 	return is_test_file || is_x_file;
 }
 
@@ -109,6 +146,43 @@ static void prv_init_out_fnames(salink_obj_t *obj)
 	}
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+static void prv_index_local_labels(salink_obj_t *obj)
+{
+	unsigned int i;
+	salink_label_t *label;
+
+	memset(obj->short_labels, 0xff, sizeof(obj->short_labels));
+	memset(obj->long_labels, 0xff, sizeof(obj->long_labels));
+
+	for (i = obj->label_start; i < obj->label_end; i++) {
+		label = &labels[i];
+		if (label->type == SALINK_LABEL_TYPE_SHORT)
+			obj->short_labels[label->id] = i;
+		else if (label->type == SALINK_LABEL_TYPE_LNG)
+			obj->long_labels[label->id] = i;
+	}
+}
+
+static salink_label_t *prv_find_local_label(salink_obj_t *obj, uint8_t lng,
+					    uint8_t id)
+{
+	uint16_t index;
+
+	salink_stats_count(label_lookups, 1);
+	if (lng == SALINK_LABEL_TYPE_LNG) {
+		if (id >= SPECASM_MAX_LONG_STRINGS)
+			return NULL;
+		index = obj->long_labels[id];
+	} else {
+		if (id >= SPECASM_MAX_SHORT_STRINGS)
+			return NULL;
+		index = obj->short_labels[id];
+	}
+
+	return index == SALINK_NO_LABEL ? NULL : &labels[index];
+}
+#else
 static salink_label_t *prv_find_local_label(salink_obj_t *obj, uint8_t lng,
 					    uint8_t id)
 {
@@ -125,6 +199,7 @@ static salink_label_t *prv_find_local_label(salink_obj_t *obj, uint8_t lng,
 
 	return NULL;
 }
+#endif
 
 static salink_global_t *prv_find_global_label_e(salink_obj_t *obj,
 						unsigned int line_no,
@@ -132,17 +207,14 @@ static salink_global_t *prv_find_global_label_e(salink_obj_t *obj,
 {
 	const char *str;
 	salink_global_t *global;
-	unsigned int i;
 
 	str = salink_get_label_str_e(id, lng);
 	if (err_type != SPECASM_ERROR_OK)
 		return NULL;
 
-	for (i = 0; i < global_count; i++) {
-		global = &globals[i];
-		if (!strcmp(str, global->name))
-			return global;
-	}
+	global = salink_find_global(str);
+	if (global)
+		return global;
 
 	snprintf(error_buf, sizeof(error_buf), "%s:%d Unknown: %s", obj->fname,
 		 line_no, str);
@@ -214,11 +286,27 @@ static void prv_flush_write_buf_e(specasm_handle_t out_f)
 	}
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+static void prv_write_bytes_e(specasm_handle_t out_f, const uint8_t *data,
+			      uint16_t size)
+{
+	prv_flush_write_buf_e(out_f);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+
+	specasm_file_write_e(out_f, data, size);
+	if (err_type == SPECASM_ERROR_OK)
+		bin_size += size;
+}
+#endif
+
 static uint16_t prv_write_bin_file_e(specasm_handle_t out_f,
 				     specasm_line_t *line)
 {
 	specasm_handle_t in_f;
+#if defined(SPECTRUM) || defined(__ZXNEXT)
 	size_t read;
+#endif
 	specasm_error_t err;
 	const char *fname;
 	uint16_t file_size = 0;
@@ -242,6 +330,16 @@ static uint16_t prv_write_bin_file_e(specasm_handle_t out_f,
 		return 0;
 	}
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_deps_add_e(fname);
+	if (err_type != SPECASM_ERROR_OK) {
+		specasm_file_close_e(in_f);
+		return 0;
+	}
+	file_size = (uint16_t)specasm_file_copy_e(out_f, in_f);
+	if (err_type == SPECASM_ERROR_OK)
+		bin_size += file_size;
+#else
 	do {
 		read = specasm_file_read_e(in_f, buf.file_buf, MAX_BUFFER_SIZE);
 		if (err_type != SPECASM_ERROR_OK)
@@ -258,10 +356,12 @@ static uint16_t prv_write_bin_file_e(specasm_handle_t out_f,
 		if (err_type != SPECASM_ERROR_OK)
 			break;
 	} while (1);
+#endif
 
 	err = err_type;
 	specasm_file_close_e(in_f);
 	err_type = err;
+	salink_stats_count(bytes_read, file_size);
 
 	return file_size;
 }
@@ -482,6 +582,56 @@ static void prv_write_line_e(specasm_handle_t f, specasm_line_t *line,
 	}
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Writes a jump whose form was changed by relaxation and returns its new
+ * size.  See link_relax.h.
+ */
+
+static uint16_t prv_write_relaxed_e(specasm_handle_t f, salink_obj_t *obj,
+				    specasm_line_t *line, unsigned int i,
+				    uint16_t offset,
+				    const salink_relax_site_t *site)
+{
+	uint8_t *op_code = line->data.op_code;
+	uint16_t target = labels[site->target].data.off;
+	int16_t diff;
+
+	if (site->type == SPECASM_LINE_TYPE_JP) {
+		diff = target - offset;
+		if (diff < -126 || diff > 129) {
+			snprintf(error_buf, sizeof(error_buf),
+				 "%s line %d label too far", obj->fname, i);
+			err_type = SALINK_ERROR_JUMP_TOO_FAR;
+			return 0;
+		}
+		op_code[0] = 0x18;
+		op_code[1] = (int8_t)(diff - 2);
+	} else {
+		if (site->type == SPECASM_LINE_TYPE_DJNZ) {
+			*op_code++ = 0x05;
+			*op_code = 0xc2;
+		} else if (*op_code == 0x18) {
+			*op_code = 0xc3;
+		} else {
+			/*
+			 * jr nz, z, nc and c map onto the jps with the same
+			 * conditions.
+			 */
+
+			*op_code += 0xa2;
+		}
+		op_code[1] = target & 0xff;
+		op_code[2] = target >> 8;
+	}
+
+	prv_write_line_e(f, line, site->size);
+
+	return site->size;
+}
+#endif
+
 static uint16_t prv_align_e(specasm_handle_t f, uint16_t align)
 {
 	unsigned int mask = align - 1;
@@ -521,6 +671,11 @@ static uint8_t prv_add_label_e(salink_obj_t *obj, uint16_t size, uint8_t type,
 		err_type = SALINK_ERROR_TOO_MANY_LABELS;
 		return 0;
 	}
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_reserve_labels_e(label_count + 1);
+	if (err_type != SPECASM_ERROR_OK)
+		return 0;
+#endif
 	label = &labels[label_count];
 	label->id = id;
 	label->type = type;
@@ -536,26 +691,31 @@ static uint8_t prv_add_label_e(salink_obj_t *obj, uint16_t size, uint8_t type,
 			err_type = SALINK_ERROR_TOO_MANY_GLOBALS;
 			return 0;
 		}
-		for (i = 0; i < global_count; i++) {
-			if (!strcmp(str, globals[i].name)) {
-				snprintf(error_buf, sizeof(error_buf),
-					 "%s defined in %s:%d and %s:%d", str,
-					 obj->fname, line_no,
-					 obj_files[globals[i].obj_index].fname,
-					 globals[i].line_no);
-				err_type = SALINK_ERROR_MULTIPLE_DEFS;
-				return 0;
-			}
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		salink_reserve_globals_e(global_count + 1);
+		if (err_type != SPECASM_ERROR_OK)
+			return 0;
+#endif
+		global = salink_find_global(str);
+		if (global) {
+			snprintf(error_buf, sizeof(error_buf),
+				 "%s defined in %s:%d and %s:%d", str,
+				 obj->fname, line_no,
+				 obj_files[global->obj_index].fname,
+				 global->line_no);
+			err_type = SALINK_ERROR_MULTIPLE_DEFS;
+			return 0;
 		}
 		if (!strcmp(str, "Main")) {
 			main_index = obj_file_count;
 			prv_init_out_fnames(obj);
 		}
-		global = &globals[i];
+		global = &globals[global_count];
 		strcpy(global->name, str);
 		global->obj_index = obj_file_count;
 		global->label_index = label_count;
 		global->line_no = line_no;
+		salink_add_global();
 		global_count++;
 		itoa(global_count, ibuf, 10);
 		(void)specasm_text_print(ibuf, SALINK_VAL_COL + 1,
@@ -598,6 +758,11 @@ static void prv_add_align_e(salink_obj_t *obj, specasm_line_t *line,
 		err_type = SALINK_ERROR_TOO_MANY_LABELS;
 		return;
 	}
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_reserve_labels_e(label_count + 1);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+#endif
 	label = &labels[label_count++];
 	label->type = SALINK_LABEL_TYPE_ALIGN;
 	label->id = line->data.op_code[0];
@@ -661,21 +826,19 @@ static void prv_add_equ_label_e(specasm_line_t *line, salink_obj_t *obj,
 	label->type = SALINK_LABEL_TYPE_EQU_GLOBAL;
 }
 
-static uint16_t prv_inc_bin_size_e(specasm_line_t *line, uint16_t size)
+uint16_t salink_inc_bin_add_e(specasm_line_t *line, uint16_t size,
+			     const char **fname)
 {
-	const char *fname;
 	specasm_stat_t stat_buf;
 	uint32_t bin_size;
 	uint32_t new_size;
 
-	fname = salink_get_label_str_e(line->data.label, line->type);
+	*fname = salink_get_label_str_e(line->data.label, line->type);
 	if (err_type != SPECASM_ERROR_OK)
 		return 0;
 
-	prv_stat_fname_e(fname, &stat_buf);
+	prv_stat_fname_e(*fname, &stat_buf);
 	if (err_type != SPECASM_ERROR_OK) {
-		snprintf(error_buf, sizeof(error_buf), "Can't open or stat %s",
-			 fname);
 		err_type = SALINK_ERROR_CANT_OPEN;
 		return 0;
 	}
@@ -684,7 +847,6 @@ static uint16_t prv_inc_bin_size_e(specasm_line_t *line, uint16_t size)
 	new_size = bin_size + size;
 
 	if ((new_size < bin_size) || (bin_size > 0xffff)) {
-		snprintf(error_buf, sizeof(error_buf), "no room for %s", fname);
 		err_type = SALINK_ERROR_PROGRAM_TOO_BIG;
 		return 0;
 	}
@@ -692,97 +854,260 @@ static uint16_t prv_inc_bin_size_e(specasm_line_t *line, uint16_t size)
 	return (uint16_t)new_size;
 }
 
-static void prv_parse_obj_e(const char *fname)
+uint16_t salink_inc_bin_size_e(specasm_line_t *line, uint16_t size)
+{
+	const char *fname = NULL;
+
+	size = salink_inc_bin_add_e(line, size, &fname);
+	if (err_type == SALINK_ERROR_CANT_OPEN)
+		snprintf(error_buf, sizeof(error_buf), "Can't open or stat %s",
+			 fname);
+	else if (err_type == SALINK_ERROR_PROGRAM_TOO_BIG)
+		snprintf(error_buf, sizeof(error_buf), "no room for %s", fname);
+
+	return size;
+}
+
+static void prv_parse_line_e(salink_obj_t *obj, specasm_line_t *line,
+			     uint16_t i, uint16_t size)
+{
+	uint8_t type;
+
+	if ((line->type == SPECASM_LINE_TYPE_LL) ||
+	    (line->type == SPECASM_LINE_TYPE_SL)) {
+		type = line->type == SPECASM_LINE_TYPE_LL
+			   ? SALINK_LABEL_TYPE_LNG
+			   : SALINK_LABEL_TYPE_SHORT;
+		(void)prv_add_label_e(obj, size, type, line->data.label, i);
+	} else if (line->type == SPECASM_LINE_TYPE_EQU) {
+		prv_add_equ_label_e(line, obj, i);
+	} else if (line->type == SPECASM_LINE_TYPE_ORG) {
+		if (got_org) {
+			strcpy(error_buf, "Only one org statement allowed");
+			err_type = SALINK_ERROR_TOO_MANY_ORGS;
+			return;
+		}
+		got_org = 1;
+		start_address = *((uint16_t *)&line->data.op_code[0]);
+	} else if (line->type == SPECASM_LINE_TYPE_ZX81) {
+		got_zx81 = 1;
+	} else if (line->type == SPECASM_LINE_TYPE_MAP) {
+		map_file = 1;
+	} else if (line->type == SPECASM_LINE_TYPE_ALIGN) {
+		prv_add_align_e(obj, line, size);
+	} else if ((line->type >= SPECASM_LINE_TYPE_INC_SHORT) &&
+		   (line->type <= SPECASM_LINE_TYPE_INC_LONG)) {
+		salink_add_queued_file_e(obj->fname, empty_str, line);
+	} else if ((line->type >= SPECASM_LINE_TYPE_INC_SYS_SHORT) &&
+		   (line->type <= SPECASM_LINE_TYPE_INC_SYS_LONG)) {
+		salink_add_queued_file_e(obj->fname, specasm_str, line);
+	}
+}
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * The object has already been loaded and scanned, possibly on another
+ * thread.  All we need to do is to visit the lines the scan recorded.
+ */
+
+static uint16_t prv_parse_lines_e(salink_obj_t *obj)
 {
 	uint16_t i;
+	salink_preload_t *pre;
 	specasm_line_t *line;
-	salink_obj_t *obj;
-	char ibuf[16];
-	uint8_t type;
 	uint16_t size = 0;
 
-	if (obj_file_count == MAX_FILES) {
-		snprintf(error_buf, sizeof(error_buf),
-			 "Max file limit %d reached", MAX_FILES);
-		err_type = SALINK_ERROR_TOO_MANY_FILES;
-		return;
+	pre = salink_take_preload(obj->fname);
+	if (!pre) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return 0;
 	}
 
-	obj = &obj_files[obj_file_count];
+	if (pre->err == SALINK_ERROR_NO_MEMORY) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		goto cleanup;
+	} else if (pre->err != SPECASM_ERROR_OK) {
+		snprintf(error_buf, sizeof(error_buf), "Can't open %s",
+			 obj->fname);
+		err_type = SALINK_ERROR_CANT_OPEN;
+		goto cleanup;
+	}
 
-	if (strlen(fname) > MAX_FNAME) {
-		err_type = SPECASM_ERROR_STRING_TOO_LONG;
-		return;
+	memcpy(&state, pre->state, sizeof(state));
+	salink_stats_count(bytes_read, salink_stats_state_bytes());
+	free(obj->state);
+	obj->state = pre->state;
+	pre->state = NULL;
+
+	for (i = 0; i < pre->num_records; i++) {
+		prv_parse_line_e(obj, &state.lines.lines[pre->records[i]],
+				 pre->records[i], pre->offsets[i]);
+		if (err_type != SPECASM_ERROR_OK)
+			goto cleanup;
 	}
-	strcpy(obj->fname, fname);
-	obj->label_start = label_count;
+
+	if (pre->bad_line == SALINK_NO_LINE) {
+		size = pre->size;
+		goto cleanup;
+	}
+
+	/*
+	 * The scan failed to size an incbin.  We size it again here to
+	 * generate the error message.
+	 */
+
+	line = &state.lines.lines[pre->bad_line];
+	(void)salink_inc_bin_size_e(line, pre->size);
+	if (err_type == SPECASM_ERROR_OK) {
+		snprintf(error_buf, sizeof(error_buf), "Can't open or stat %s",
+			 salink_get_label_str_e(line->data.label, line->type));
+		err_type = SALINK_ERROR_CANT_OPEN;
+	}
+
+cleanup:
+	salink_free_preload(pre);
+
+	return size;
+}
+#else
+static uint16_t prv_parse_lines_e(salink_obj_t *obj)
+{
+	uint16_t i;
+	specasm_line_t *line;
+	uint16_t size = 0;
 
 	specasm_load_e(obj->fname);
 	if (err_type != SPECASM_ERROR_OK) {
-		snprintf(error_buf, sizeof(error_buf), "Can't open %s", fname);
+		snprintf(error_buf, sizeof(error_buf), "Can't open %s",
+			 obj->fname);
 		err_type = SALINK_ERROR_CANT_OPEN;
-		return;
+		return 0;
 	}
 
 	for (i = 0; i < state.lines.num_lines; i++) {
 		line = &state.lines.lines[i];
-		if ((line->type == SPECASM_LINE_TYPE_LL) ||
-		    (line->type == SPECASM_LINE_TYPE_SL)) {
-			type = line->type == SPECASM_LINE_TYPE_LL
-				   ? SALINK_LABEL_TYPE_LNG
-				   : SALINK_LABEL_TYPE_SHORT;
-			(void)prv_add_label_e(obj, size, type, line->data.label,
-					      i);
-		} else if (line->type == SPECASM_LINE_TYPE_EQU) {
-			prv_add_equ_label_e(line, obj, i);
-		} else if (line->type == SPECASM_LINE_TYPE_ORG) {
-			if (got_org) {
-				strcpy(error_buf,
-				       "Only one org statement allowed");
-				err_type = SALINK_ERROR_TOO_MANY_ORGS;
-				return;
-			}
-			got_org = 1;
-			start_address = *((uint16_t *)&line->data.op_code[0]);
-		} else if (line->type == SPECASM_LINE_TYPE_ZX81) {
-			got_zx81 = 1;
-		} else if (line->type == SPECASM_LINE_TYPE_MAP) {
-			map_file = 1;
-		} else if (line->type == SPECASM_LINE_TYPE_ALIGN) {
-			prv_add_align_e(obj, line, size);
-		} else if ((line->type >= SPECASM_LINE_TYPE_INC_SHORT) &&
-			   (line->type <= SPECASM_LINE_TYPE_INC_LONG)) {
-			salink_add_queued_file_e(obj->fname, empty_str, line);
-		} else if ((line->type >= SPECASM_LINE_TYPE_INC_SYS_SHORT) &&
-			   (line->type <= SPECASM_LINE_TYPE_INC_SYS_LONG)) {
-			salink_add_queued_file_e(obj->fname, specasm_str, line);
-		} else if ((line->type == SPECASM_LINE_TYPE_INC_BIN_SHORT) ||
-			   (line->type == SPECASM_LINE_TYPE_INC_BIN_LONG)) {
-			size = prv_inc_bin_size_e(line, size);
+		if ((line->type == SPECASM_LINE_TYPE_INC_BIN_SHORT) ||
+		    (line->type == SPECASM_LINE_TYPE_INC_BIN_LONG)) {
+			size = salink_inc_bin_size_e(line, size);
 		} else {
+			prv_parse_line_e(obj, line, i, size);
 			size += specasm_compute_line_size(line);
 		}
 
 		if (err_type != SPECASM_ERROR_OK)
-			return;
+			return 0;
 	}
 
+	return size;
+}
+#endif
+
+static void prv_parse_obj_e(const char *fname)
+{
+	salink_obj_t *obj;
+	char ibuf[16];
+	uint16_t size;
+
+	if (obj_file_count == MAX_FILES) {
+		snprintf(error_buf, sizeof(error_buf),
+			 "Max file limit %d reached", MAX_FILES);
+		err_type = SALINK_ERROR_TOO_MANY_FILES;
+		return;
+	}
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_reserve_objs_e(obj_file_count + 1);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+#endif
+
+	obj = &obj_files[obj_file_count];
+
+	if (strlen(fname) > MAX_FNAME) {
+		err_type = SPECASM_ERROR_STRING_TOO_LONG;
+		return;
+	}
+	strcpy(obj->fname, fname);
+	obj->label_start = label_count;
+
+	size = prv_parse_lines_e(obj);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+
 	obj_file_count++;
+	salink_stats_count(objs_parsed, 1);
 	obj->label_end = label_count;
 	obj->size = size;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	prv_index_local_labels(obj);
+	salink_deps_add_e(fname);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+#endif
 
 	itoa(obj_file_count, ibuf, 10);
 	(void)specasm_text_print(ibuf, SALINK_VAL_COL + 1,
 				 SALINK_FIELD_FILES_ROW, SPECASM_CODE_COLOUR);
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Files below preloaded_files in the queue have already been handed to
+ * the preloader.  Parsing a file only ever pushes new files on top of
+ * the queue, so we only need to preload the files above this mark.
+ * The files are still parsed one at a time in the order they're popped.
+ */
+
+static void prv_preload_queued_files(void)
+{
+	const char **fnames;
+	unsigned int i;
+
+	/*
+	 * Running out of memory here isn't an error.  The files will
+	 * be loaded when they're parsed.
+	 */
+
+	if (queued_files > preloaded_files) {
+		fnames = malloc((queued_files - preloaded_files) *
+				sizeof(*fnames));
+		if (fnames) {
+			for (i = preloaded_files; i < queued_files; i++)
+				fnames[i - preloaded_files] =
+				    salink_queued_fname(i);
+			salink_preload_objs(fnames,
+					    queued_files - preloaded_files);
+			free(fnames);
+		}
+	}
+	preloaded_files = queued_files;
+}
+#endif
+
 static void prv_process_queued_files_e(void)
 {
 	const char *path;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	preloaded_files = 0;
+#endif
 	while (queued_files > 0) {
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		prv_preload_queued_files();
+		preloaded_files = queued_files - 1;
+#endif
 		--queued_files;
-		path = &buf.fname[queued_files][0];
+		path = salink_queued_fname(queued_files);
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		if (salink_defer_test_e(path)) {
+			if (err_type != SPECASM_ERROR_OK)
+				return;
+			continue;
+		}
+#endif
 		prv_parse_obj_e(path);
 		if (err_type != SPECASM_ERROR_OK)
 			return;
@@ -791,15 +1116,18 @@ static void prv_process_queued_files_e(void)
 
 static int prv_obj_file_cmp(const void *a, const void *b)
 {
-	const uint8_t *a_i = (const uint8_t *)a;
-	const uint8_t *b_i = (const uint8_t *)b;
+	const salink_obj_index_t *a_i = (const salink_obj_index_t *)a;
+	const salink_obj_index_t *b_i = (const salink_obj_index_t *)b;
 
 	return strcmp(obj_files[*a_i].fname, obj_files[*b_i].fname);
 }
 
 static uint8_t prv_order_objects_e(void)
 {
-	uint8_t i;
+	salink_obj_index_t i;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_obj_index_t *new_order;
+#endif
 
 	/*
 	 * We want to put the object file with the Main label
@@ -808,6 +1136,20 @@ static uint8_t prv_order_objects_e(void)
 	 * written out to the final binary.
 	 */
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (obj_file_count > obj_files_order_max) {
+		new_order = realloc(obj_files_order,
+				    obj_file_count * sizeof(*obj_files_order));
+		if (!new_order) {
+			strcpy(error_buf, "Out of memory");
+			err_type = SALINK_ERROR_NO_MEMORY;
+			return 0;
+		}
+		obj_files_order = new_order;
+		obj_files_order_max = obj_file_count;
+	}
+#endif
+
 	for (i = 0; i < obj_file_count; i++)
 		obj_files_order[i] = i;
 
@@ -817,8 +1159,8 @@ static uint8_t prv_order_objects_e(void)
 	}
 
 	if (obj_file_count > 2) {
-		qsort(&obj_files_order[1], obj_file_count - 1, sizeof(uint8_t),
-		      prv_obj_file_cmp);
+		qsort(&obj_files_order[1], obj_file_count - 1,
+		      sizeof(*obj_files_order), prv_obj_file_cmp);
 	}
 
 	return main_index == (obj_file_count - 1);
@@ -826,7 +1168,7 @@ static uint8_t prv_order_objects_e(void)
 
 static void prv_check_duplicate_objs_e(void)
 {
-	uint8_t i;
+	salink_obj_index_t i;
 	const char *fname1;
 
 	/*
@@ -854,7 +1196,7 @@ static void prv_check_duplicate_objs_e(void)
 
 static void prv_complete_absolutes_e(void)
 {
-	uint8_t i;
+	salink_obj_index_t i;
 	uint16_t j;
 	salink_obj_t *obj;
 	salink_label_t *label;
@@ -865,6 +1207,11 @@ static void prv_complete_absolutes_e(void)
 
 	for (i = 0; i < obj_file_count; i++) {
 		obj = &obj_files[obj_files_order[i]];
+		if (salink_obj_excluded(obj))
+			continue;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		obj->addr = real_off;
+#endif
 		for (j = obj->label_start; j < obj->label_end; j++) {
 			label = &labels[j];
 
@@ -888,12 +1235,39 @@ static void prv_complete_absolutes_e(void)
 			label->data.off += real_off;
 		}
 		real_off += obj->size;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		obj->end = real_off;
+#endif
 	}
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Lays the objects out again, widening the jumps that can't reach their
+ * targets, until no more jumps need to be widened.  See link_relax.h.
+ */
+
+static void prv_relax_e(void)
+{
+	salink_relax_collect_e(obj_files_order, label_count);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+
+	do {
+		salink_relax_layout_e();
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+		prv_complete_absolutes_e();
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	} while (salink_relax_widen());
+}
+#endif
+
 static void prv_evaluate_global_equs_e(void)
 {
-	uint8_t i;
+	unsigned int i;
 	salink_obj_t *obj;
 	salink_label_t *label;
 	salink_global_t *global;
@@ -921,6 +1295,9 @@ static uint16_t prv_link_obj_e(specasm_handle_t f, salink_obj_t *obj,
 	uint8_t id;
 	uint8_t lng;
 	uint16_t *addr;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	const salink_relax_site_t *site;
+#endif
 
 	for (i = 0; i < state.lines.num_lines; i++) {
 		id_pos = 1;
@@ -945,6 +1322,17 @@ static uint16_t prv_link_obj_e(specasm_handle_t f, salink_obj_t *obj,
 		if (line->type >= SPECASM_LINE_TYPE_EXP_ADJ)
 			salink_apply_expressions_e(line, obj, i);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		site = salink_relax_find(obj - obj_files, i);
+		if (site) {
+			offset += prv_write_relaxed_e(f, obj, line, i, offset,
+						      site);
+			if (err_type != SPECASM_ERROR_OK)
+				return 0;
+			continue;
+		}
+#endif
+
 		switch (line->type) {
 		case SPECASM_LINE_TYPE_ALIGN:
 			offset += prv_align_e(f, 1 << line->data.op_code[0]);
@@ -1097,18 +1485,34 @@ static void prv_just_write_something(specasm_handle_t f)
 static void prv_link_e(uint8_t main_loaded)
 {
 	char ibuf[16];
-	uint8_t i;
+	salink_obj_index_t i;
 	specasm_handle_t f;
 	uint16_t offset = start_address;
 	salink_obj_t *obj = &obj_files[main_index];
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	const uint8_t *old;
+	uint16_t size;
+#endif
 
 	f = specasm_file_wopen_e(image_name);
 	if (err_type != SPECASM_ERROR_OK)
 		return;
 	for (i = 0; i < obj_file_count; i++) {
 		obj = &obj_files[obj_files_order[i]];
+		if (salink_obj_excluded(obj))
+			continue;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		old = salink_incr_find(i, &size);
+		if (old) {
+			prv_write_bytes_e(f, old, size);
+			if (err_type != SPECASM_ERROR_OK)
+				goto on_error;
+			offset += size;
+			continue;
+		}
+#endif
 		if (i > 0 || !main_loaded) {
-			specasm_load_e(obj->fname);
+			salink_load_obj_e(obj);
 			if (err_type != SPECASM_ERROR_OK)
 				goto on_error;
 		}
@@ -1144,6 +1548,7 @@ static void prv_link_e(uint8_t main_loaded)
 	specasm_file_close_e(f);
 	if (err_type != SPECASM_ERROR_OK)
 		goto on_error;
+	salink_stats_count(bytes_written, bin_size);
 
 	return;
 
@@ -1158,20 +1563,170 @@ on_error:
 	return;
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+static void prv_save_labels_e(void)
+{
+	saved_labels = malloc((label_count + 1) * sizeof(*labels));
+	if (!saved_labels) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return;
+	}
+	memcpy(saved_labels, labels, label_count * sizeof(*labels));
+	saved_label_count = label_count;
+}
+
+static void prv_extend_for_tests(void)
+{
+	memcpy(labels, saved_labels, saved_label_count * sizeof(*labels));
+	label_count = saved_label_count;
+	free(saved_labels);
+	saved_labels = NULL;
+	extending = 1;
+	bin_size = 0;
+	buf_count = 0;
+}
+
+static void prv_free_single_pass(void)
+{
+	free(saved_labels);
+	saved_labels = NULL;
+	extending = 0;
+	salink_free_deferred_tests();
+}
+#endif
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * On the host we read the whole directory up front so that all the
+ * objects in it can be loaded in parallel.  They're still parsed in
+ * directory order.
+ */
+
+static void prv_parse_dir_e(specasm_dir_t dir)
+{
+	specasm_dirent_t dirent;
+	const char *fname;
+	char **fnames = NULL;
+	char **new_fnames;
+	unsigned int count = 0;
+	unsigned int max = 0;
+	unsigned int i;
+
+	while (specasm_readdir(dir, &dirent)) {
+		if (specasm_isdirent_dir(dirent))
+			continue;
+		fname = specasm_getdirname(dirent);
+		if (!prv_check_file(fname))
+			continue;
+		if (count == max) {
+			max = max ? max * 2 : 16;
+			new_fnames = realloc(fnames, max * sizeof(*fnames));
+			if (!new_fnames)
+				goto on_oom;
+			fnames = new_fnames;
+		}
+		fnames[count] = strdup(fname);
+		if (!fnames[count])
+			goto on_oom;
+		count++;
+	}
+
+	salink_preload_objs((const char *const *)fnames, count);
+	for (i = 0; i < count; i++) {
+		prv_parse_obj_e(fnames[i]);
+		if (err_type != SPECASM_ERROR_OK)
+			break;
+	}
+	goto cleanup;
+
+on_oom:
+	strcpy(error_buf, "Out of memory");
+	err_type = SALINK_ERROR_NO_MEMORY;
+
+cleanup:
+	for (i = 0; i < count; i++)
+		free(fnames[i]);
+	free(fnames);
+}
+#endif
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Files written alongside the binary are named after it.  Those of the
+ * test binary share its base name.
+ *
+ * The rules for the main binary and the test binary are both written to
+ * <name>.d.  The objects in the current directory are listed individually
+ * but the directory itself isn't, as writing the binary would make the
+ * rule out of date.
+ */
+
+static void prv_side_fname(char *fname, const char *ext)
+{
+	char *period;
+
+	strcpy(fname, image_name);
+	period = strrchr(fname, '.');
+	if ((link_mode == SALINK_MODE_TEST) && period)
+		*period = 0;
+	strcat(fname, ext);
+}
+
+static void prv_write_deps_e(void)
+{
+	char deps_name[MAX_FNAME + 5];
+
+	prv_side_fname(deps_name, ".d");
+	salink_deps_write_e(image_name, deps_name, deps_written);
+	if (err_type == SPECASM_ERROR_OK)
+		deps_written = 1;
+}
+#endif
+
 static void prv_salink_e(void)
 {
 	uint8_t main_loaded;
 	char ibuf[16];
+#if defined(SPECTRUM) || defined(__ZXNEXT)
 	specasm_dirent_t dirent;
+#endif
 	uint8_t name_len;
 	char back_ch = 0;
+	specasm_dir_t dir;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	char incr_name[MAX_FNAME + 5];
+#endif
+
+	salink_stats_start(SALINK_PHASE_SCAN);
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (link_flags & SALINK_FLAG_MAP_FULL)
+		map_file = 1;
+
+	if (extending) {
+		if (main_index != SALINK_NO_OBJ)
+			prv_init_out_fnames(&obj_files[main_index]);
+		salink_queue_deferred_tests_e();
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+#endif
 
-	specasm_dir_t dir = specasm_opendir_e(".");
+	dir = specasm_opendir_e(".");
 	if (err_type != SPECASM_ERROR_OK) {
 		strcpy(error_buf, "Failed to read directory");
 		err_type = SALINK_ERROR_READDIR;
 		return;
 	}
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	prv_parse_dir_e(dir);
+	specasm_closedir(dir);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+#else
 	while (specasm_readdir(dir, &dirent)) {
 		if (specasm_isdirent_dir(dirent))
 			continue;
@@ -1184,11 +1739,33 @@ static void prv_salink_e(void)
 		}
 	}
 	specasm_closedir(dir);
+#endif
 
 	prv_process_queued_files_e();
 	if (err_type != SPECASM_ERROR_OK)
 		return;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	while (salink_lib_queue_members_e()) {
+		prv_process_queued_files_e();
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+#endif
+
+	salink_stats_stop(SALINK_PHASE_SCAN);
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if ((link_flags & SALINK_FLAG_SINGLE_PASS) &&
+	    (link_mode == SALINK_MODE_LINK)) {
+		prv_save_labels_e();
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+#endif
+
 	if (obj_file_count == 0)
 		return;
 
@@ -1197,7 +1774,7 @@ static void prv_salink_e(void)
 	 * or a .x file but we need to have one.
 	 */
 
-	if (main_index == 0xFF) {
+	if (main_index == SALINK_NO_OBJ) {
 		if (((link_mode == SALINK_MODE_LINK) && (!got_test)) ||
 		    (link_mode == SALINK_MODE_TEST)) {
 			strcpy(error_buf, "No Main label defined");
@@ -1219,28 +1796,87 @@ static void prv_salink_e(void)
 				 SALINK_FIELD_STARTADDR_ROW,
 				 SPECASM_CODE_COLOUR);
 
+	salink_stats_start(SALINK_PHASE_LAYOUT);
 	main_loaded = prv_order_objects_e();
 	if (err_type != SPECASM_ERROR_OK)
 		return;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	/*
+	 * state may contain any of the objects of the main binary at this
+	 * point.
+	 */
+
+	if (extending)
+		main_loaded = 0;
+#endif
+
 	prv_check_duplicate_objs_e();
 	if (err_type != SPECASM_ERROR_OK)
 		return;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (link_flags & SALINK_FLAG_DROP_UNUSED) {
+		salink_drop_unused_e(main_index);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+		main_loaded = 0;
+	}
+
+	if (link_flags & SALINK_FLAG_PACK_ALIGNS) {
+		pack_saved =
+		    salink_pack_objects_e(obj_files_order, start_address);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+
+	if (link_flags & SALINK_FLAG_RELAX) {
+		prv_relax_e();
+		main_loaded = 0;
+	} else {
+		prv_complete_absolutes_e();
+	}
+#else
 	prv_complete_absolutes_e();
+#endif
 	if (err_type != SPECASM_ERROR_OK)
 		return;
+	salink_stats_stop(SALINK_PHASE_LAYOUT);
 
+	salink_stats_start(SALINK_PHASE_EQUS);
 	prv_evaluate_global_equs_e();
 	if (err_type != SPECASM_ERROR_OK)
 		return;
+	salink_stats_stop(SALINK_PHASE_EQUS);
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (link_flags & SALINK_FLAG_INCREMENTAL) {
+		prv_side_fname(incr_name, link_mode == SALINK_MODE_TEST
+					      ? ".tlk"
+					      : ".lnk");
+		salink_incr_begin_e(obj_files_order, start_address, image_name,
+				    incr_name);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+#endif
 
 	specasm_remove_file(image_name);
 	specasm_remove_file(map_name);
 
+	salink_stats_start(SALINK_PHASE_WRITE);
 	prv_link_e(main_loaded);
 	if (err_type != SPECASM_ERROR_OK)
 		return;
+	salink_stats_stop(SALINK_PHASE_WRITE);
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (link_flags & SALINK_FLAG_INCREMENTAL) {
+		salink_incr_save_e(incr_name, bin_size);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+#endif
 
 	if (map_file) {
 		name_len = strlen(map_name);
@@ -1255,12 +1891,19 @@ static void prv_salink_e(void)
 		if (back_ch)
 			map_name[sizeof(blank_field) - 2] = back_ch;
 
+		salink_stats_start(SALINK_PHASE_MAP);
 		specasm_write_map_e();
+		salink_stats_stop(SALINK_PHASE_MAP);
 	} else {
 		(void)specasm_text_print("None", SALINK_VAL_COL + 1,
 					 SALINK_FIELD_MAP_ROW,
 					 SPECASM_CODE_COLOUR);
 	}
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if ((err_type == SPECASM_ERROR_OK) && (link_flags & SALINK_FLAG_DEPS))
+		prv_write_deps_e();
+#endif
 }
 
 static void prv_setup_screen(void)
@@ -1305,9 +1948,14 @@ static int prv_salink_pass_e(void)
 	int err_buf_len;
 	uint16_t last_line = SALINK_STATUS_ROW;
 	int retval = 0;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	char msg[SPECASM_MAX_SCRATCH];
+	int saved;
+#endif
 
 	prv_setup_screen();
 
+	salink_stats_count(passes, 1);
 	prv_salink_e();
 	if (err_type != SPECASM_ERROR_OK) {
 		if (err_type >= SPECASM_MAX_ERRORS)
@@ -1325,7 +1973,8 @@ static int prv_salink_pass_e(void)
 			err_buf_len -= SPECASM_LINE_MAX_LEN;
 		} while (1);
 		retval = 1;
-	} else if ((link_mode == SALINK_MODE_LINK) && (main_index == 0xFF)) {
+	} else if ((link_mode == SALINK_MODE_LINK) &&
+		   (main_index == SALINK_NO_OBJ)) {
 		(void)specasm_text_print("Skipping main binary", 0,
 					 SALINK_STATUS_ROW,
 					 SPECASM_SUCCESS_COLOUR);
@@ -1334,7 +1983,37 @@ static int prv_salink_pass_e(void)
 		(void)specasm_text_print("Link succeeded", 0, SALINK_STATUS_ROW,
 					 SPECASM_SUCCESS_COLOUR);
 		++last_line;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		if (link_flags & SALINK_FLAG_PACK_ALIGNS) {
+			snprintf(msg, sizeof(msg), "Packing saved %u bytes",
+				 pack_saved);
+			(void)specasm_text_print(msg, 0, last_line,
+						 SPECASM_SUCCESS_COLOUR);
+			++last_line;
+		}
+		if (link_flags & SALINK_FLAG_RELAX) {
+			saved = salink_relax_saved();
+			snprintf(msg, sizeof(msg), "%d byte%s %s by relaxation",
+				 saved < 0 ? -saved : saved,
+				 (saved == 1) || (saved == -1) ? "" : "s",
+				 saved < 0 ? "added" : "saved");
+			(void)specasm_text_print(msg, 0, last_line,
+						 SPECASM_SUCCESS_COLOUR);
+			++last_line;
+		}
+		if (link_flags & SALINK_FLAG_INCREMENTAL) {
+			snprintf(msg, sizeof(msg), "Reused %u of %u objects",
+				 salink_incr_reused(), salink_incr_linked());
+			(void)specasm_text_print(msg, 0, last_line,
+						 SPECASM_SUCCESS_COLOUR);
+			++last_line;
+		}
+#endif
 	}
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_relax_free();
+	salink_incr_free();
+#endif
 	specasm_screen_flush(last_line + 2);
 
 	return retval;
@@ -1356,19 +2035,43 @@ int salink_link_e(void)
 
 		specasm_sleep_ms(500);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		if ((link_flags & SALINK_FLAG_SINGLE_PASS) &&
+		    (link_mode == SALINK_MODE_LINK)) {
+			prv_extend_for_tests();
+			continue;
+		}
+#endif
+
 		/*
 		 * Reset state.
 		 */
 
+		salink_free_objs();
 		queued_files = 0;
 		label_count = 0;
 		start_address = 0x8000;
 		got_org = 0;
-		global_count = 0;
+		salink_reset_globals();
 		obj_file_count = 0;
 		bin_size = 0;
 		buf_count = 0;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		salink_deps_reset();
+#endif
 	}
 
+	salink_free_objs();
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_free_preloads();
+	salink_lib_free();
+	salink_deps_reset();
+	prv_free_single_pass();
+	free(obj_files_order);
+	obj_files_order = NULL;
+	obj_files_order_max = 0;
+	salink_free_tables();
+#endif
+
 	return retval;
 }
@@ -23,4 +23,19 @@
 
 int salink_link_e(void);
 
+/*
+ * Returns size plus the size of the file included by the incbin line.
+ */
+
+uint16_t salink_inc_bin_size_e(specasm_line_t *line, uint16_t size);
+
+/*
+ * As salink_inc_bin_size_e() but sets only err_type on failure, leaving
+ * error_buf alone, so it can be called from the preload threads.  fname
+ * is set to the name of the included file.
+ */
+
+uint16_t salink_inc_bin_add_e(specasm_line_t *line, uint16_t size,
+			     const char **fname);
+
 #endif
@@ -0,0 +1,300 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_pack.h"
+
+/*
+ * The aligns of object i are stored in aligns, from align_first[i] up to
+ * align_first[i + 1].
+ */
+
+struct prv_pack_align_t_ {
+	uint16_t off;
+	uint8_t shift;
+};
+typedef struct prv_pack_align_t_ prv_pack_align_t;
+
+static prv_pack_align_t *aligns;
+static unsigned int *align_first;
+
+/*
+ * Fillers, the objects without aligns, sorted by descending size.  skip
+ * is used to step over the fillers that have already been placed.
+ */
+
+static salink_obj_index_t *fillers;
+static unsigned int *skip;
+static unsigned int filler_count;
+
+static uint8_t prv_has_aligns(salink_obj_index_t index)
+{
+	return align_first[index + 1] > align_first[index];
+}
+
+/*
+ * Returns the address that follows the object when it's placed at addr
+ * and adds the padding its aligns need to *padding.
+ */
+
+static unsigned int prv_place(salink_obj_index_t index, unsigned int addr,
+			      unsigned int *padding)
+{
+	unsigned int i;
+	unsigned int align;
+	unsigned int adjust;
+
+	for (i = align_first[index]; i < align_first[index + 1]; i++) {
+		align = 1u << aligns[i].shift;
+		adjust = (addr + aligns[i].off) & (align - 1);
+		if (adjust > 0) {
+			*padding += align - adjust;
+			addr += align - adjust;
+		}
+	}
+
+	return addr + obj_files[index].size;
+}
+
+static unsigned int prv_order_padding(const salink_obj_index_t *order,
+				      uint16_t start)
+{
+	unsigned int i;
+	unsigned int addr = start;
+	unsigned int padding = 0;
+
+	for (i = 0; i < obj_file_count; i++)
+		if (!salink_obj_excluded(&obj_files[order[i]]))
+			addr = prv_place(order[i], addr, &padding);
+
+	return padding;
+}
+
+static uint8_t prv_index_aligns(void)
+{
+	unsigned int i;
+	unsigned int j;
+	unsigned int count = 0;
+	salink_label_t *label;
+
+	for (i = 0; i < obj_file_count; i++)
+		for (j = obj_files[i].label_start; j < obj_files[i].label_end;
+		     j++)
+			if (labels[j].type == SALINK_LABEL_TYPE_ALIGN)
+				count++;
+
+	aligns = malloc((count + 1) * sizeof(*aligns));
+	align_first = malloc((obj_file_count + 1) * sizeof(*align_first));
+	if (!aligns || !align_first)
+		return 0;
+
+	count = 0;
+	for (i = 0; i < obj_file_count; i++) {
+		align_first[i] = count;
+		for (j = obj_files[i].label_start; j < obj_files[i].label_end;
+		     j++) {
+			label = &labels[j];
+			if (label->type != SALINK_LABEL_TYPE_ALIGN)
+				continue;
+			aligns[count].off = label->data.off;
+			aligns[count++].shift = label->id;
+		}
+	}
+	align_first[i] = count;
+
+	return 1;
+}
+
+static int prv_filler_cmp(const void *a, const void *b)
+{
+	const salink_obj_index_t *a_i = (const salink_obj_index_t *)a;
+	const salink_obj_index_t *b_i = (const salink_obj_index_t *)b;
+	unsigned int a_size = obj_files[*a_i].size;
+	unsigned int b_size = obj_files[*b_i].size;
+
+	if (a_size != b_size)
+		return a_size > b_size ? -1 : 1;
+
+	/*
+	 * qsort isn't stable so we break ties on the file names, which
+	 * determine the existing order.
+	 */
+
+	return strcmp(obj_files[*a_i].fname, obj_files[*b_i].fname);
+}
+
+static unsigned int prv_next_filler(unsigned int i)
+{
+	unsigned int next = i;
+	unsigned int tmp;
+
+	while (skip[next] != next)
+		next = skip[next];
+	while (i != next) {
+		tmp = skip[i];
+		skip[i] = next;
+		i = tmp;
+	}
+
+	return next;
+}
+
+/*
+ * Returns the position in fillers of the largest unplaced filler no
+ * bigger than gap, or filler_count if there isn't one.
+ */
+
+static unsigned int prv_find_filler(unsigned int gap)
+{
+	unsigned int lo = 0;
+	unsigned int hi = filler_count;
+	unsigned int mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (obj_files[fillers[mid]].size > gap)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return prv_next_filler(lo);
+}
+
+static void prv_pack(const salink_obj_index_t *order,
+		     salink_obj_index_t *packed, salink_obj_index_t *rest,
+		     uint8_t *placed, uint16_t start)
+{
+	unsigned int i;
+	unsigned int f;
+	unsigned int best;
+	unsigned int padding;
+	unsigned int best_padding;
+	unsigned int rest_count = 0;
+	unsigned int count = 1;
+	unsigned int addr;
+
+	padding = 0;
+	packed[0] = order[0];
+	addr = prv_place(order[0], start, &padding);
+
+	for (i = 1; i < obj_file_count; i++) {
+		if (salink_obj_excluded(&obj_files[order[i]]))
+			continue;
+		if (prv_has_aligns(order[i]))
+			rest[rest_count++] = order[i];
+		else
+			fillers[filler_count++] = order[i];
+	}
+	qsort(fillers, filler_count, sizeof(*fillers), prv_filler_cmp);
+	for (i = 0; i <= filler_count; i++)
+		skip[i] = i;
+
+	while (rest_count > 0) {
+		best = 0;
+		best_padding = UINT_MAX;
+		for (i = 0; i < rest_count && best_padding > 0; i++) {
+			padding = 0;
+			(void)prv_place(rest[i], addr, &padding);
+			if (padding < best_padding) {
+				best = i;
+				best_padding = padding;
+			}
+		}
+
+		if (best_padding > 0) {
+			f = prv_find_filler(best_padding);
+			if (f < filler_count) {
+				skip[f] = f + 1;
+				placed[fillers[f]] = 1;
+				packed[count++] = fillers[f];
+				addr += obj_files[fillers[f]].size;
+				continue;
+			}
+		}
+
+		packed[count++] = rest[best];
+		addr = prv_place(rest[best], addr, &padding);
+		memmove(&rest[best], &rest[best + 1],
+			(--rest_count - best) * sizeof(*rest));
+	}
+
+	/*
+	 * The remaining fillers and the excluded objects go at the end in
+	 * their existing order.
+	 */
+
+	for (i = 1; i < obj_file_count; i++)
+		if (!placed[order[i]] &&
+		    (salink_obj_excluded(&obj_files[order[i]]) ||
+		     !prv_has_aligns(order[i])))
+			packed[count++] = order[i];
+}
+
+unsigned int salink_pack_objects_e(salink_obj_index_t *order, uint16_t start)
+{
+	unsigned int before;
+	unsigned int after;
+	salink_obj_index_t *packed = NULL;
+	salink_obj_index_t *rest = NULL;
+	uint8_t *placed = NULL;
+	unsigned int saved = 0;
+
+	if (obj_file_count < 3)
+		return 0;
+
+	filler_count = 0;
+	packed = malloc(obj_file_count * sizeof(*packed));
+	rest = malloc(obj_file_count * sizeof(*rest));
+	placed = calloc(obj_file_count, sizeof(*placed));
+	fillers = malloc(obj_file_count * sizeof(*fillers));
+	skip = malloc((obj_file_count + 1) * sizeof(*skip));
+	if (!packed || !rest || !placed || !fillers || !skip ||
+	    !prv_index_aligns()) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		goto cleanup;
+	}
+
+	before = prv_order_padding(order, start);
+	if (before == 0)
+		goto cleanup;
+
+	prv_pack(order, packed, rest, placed, start);
+	after = prv_order_padding(packed, start);
+	if (after < before) {
+		memcpy(order, packed, obj_file_count * sizeof(*order));
+		saved = before - after;
+	}
+
+cleanup:
+	free(skip);
+	skip = NULL;
+	free(fillers);
+	fillers = NULL;
+	free(placed);
+	free(rest);
+	free(packed);
+	free(align_first);
+	align_first = NULL;
+	free(aligns);
+	aligns = NULL;
+
+	return saved;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_PACK_H
+#define LINK_PACK_H
+
+#include "salink.h"
+
+/*
+ * Host only.  Reorders all but the first of the objects in order, which
+ * must hold the indices of all the objects, to reduce the padding added
+ * by their aligns when the binary starts at start.
+ *
+ * Objects containing aligns are placed one at a time, picking the one
+ * that needs the least padding at the current address.  Before placing
+ * an object that needs padding, the gap is filled with the largest object
+ * without aligns that fits.  Ties are broken by the existing order.  The
+ * order is left as it was if this doesn't reduce the padding.
+ *
+ * Must be called before the label offsets are made absolute.  Returns
+ * the number of bytes of padding saved.
+ */
+
+unsigned int salink_pack_objects_e(salink_obj_index_t *order, uint16_t start);
+
+#endif
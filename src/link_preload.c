@@ -0,0 +1,332 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "link_lib.h"
+#include "link_obj.h"
+#include "link_preload.h"
+#include "peer.h"
+
+/*
+ * pending holds the objects that have been preloaded, in the order in
+ * which they were preloaded.  An entry is set to NULL when its object
+ * is taken.  pending_index is an open addressed hash table, keyed on
+ * file name, with at least twice as many slots as pending has entries.
+ * Each slot holds the position of an object in pending plus one, 0 if
+ * the slot is empty or SALINK_PRELOAD_TAKEN if its object has been
+ * taken.
+ */
+
+#define SALINK_PRELOAD_TAKEN UINT_MAX
+
+static salink_preload_t **pending;
+static unsigned int pending_count;
+static unsigned int pending_max;
+static unsigned int *pending_index;
+static unsigned int index_mask;
+
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static salink_preload_t **batch;
+static unsigned int batch_count;
+static unsigned int next_preload;
+
+static uint8_t prv_is_record(uint8_t type)
+{
+	return (type == SPECASM_LINE_TYPE_LL) ||
+	       (type == SPECASM_LINE_TYPE_SL) ||
+	       (type == SPECASM_LINE_TYPE_EQU) ||
+	       (type == SPECASM_LINE_TYPE_ORG) ||
+	       (type == SPECASM_LINE_TYPE_ZX81) ||
+	       (type == SPECASM_LINE_TYPE_MAP) ||
+	       (type == SPECASM_LINE_TYPE_ALIGN) ||
+	       ((type >= SPECASM_LINE_TYPE_INC_SHORT) &&
+		(type <= SPECASM_LINE_TYPE_INC_SYS_LONG));
+}
+
+/*
+ * Runs on a worker thread.  state and err_type are thread local so we can
+ * use the normal loader.
+ */
+
+static void prv_scan_obj(salink_preload_t *pre)
+{
+	uint16_t i;
+	uint16_t num_lines;
+	specasm_line_t *line;
+	uint16_t size = 0;
+	uint16_t new_size;
+	const char *fname;
+
+	pre->bad_line = SALINK_NO_LINE;
+
+	err_type = SPECASM_ERROR_OK;
+	salink_lib_load_e(pre->fname);
+	if (err_type != SPECASM_ERROR_OK) {
+		pre->err = err_type;
+		err_type = SPECASM_ERROR_OK;
+		return;
+	}
+
+	num_lines = state.lines.num_lines;
+	pre->state = malloc(sizeof(state));
+	pre->records = malloc((num_lines + 1) * sizeof(*pre->records));
+	pre->offsets = malloc((num_lines + 1) * sizeof(*pre->offsets));
+	if (!pre->state || !pre->records || !pre->offsets) {
+		pre->err = SALINK_ERROR_NO_MEMORY;
+		return;
+	}
+	memcpy(pre->state, &state, sizeof(state));
+
+	for (i = 0; i < num_lines; i++) {
+		line = &state.lines.lines[i];
+		if ((line->type == SPECASM_LINE_TYPE_INC_BIN_SHORT) ||
+		    (line->type == SPECASM_LINE_TYPE_INC_BIN_LONG)) {
+
+			/*
+			 * error_buf is shared by all threads so the linker
+			 * generates the error message when it reaches the
+			 * bad line.
+			 */
+
+			new_size = salink_inc_bin_add_e(line, size, &fname);
+			if (err_type != SPECASM_ERROR_OK) {
+				err_type = SPECASM_ERROR_OK;
+				pre->bad_line = i;
+				break;
+			}
+			size = new_size;
+			continue;
+		}
+		if (prv_is_record(line->type)) {
+			pre->records[pre->num_records] = i;
+			pre->offsets[pre->num_records++] = size;
+		}
+		size += specasm_compute_line_size(line);
+	}
+	pre->size = size;
+}
+
+static void *prv_worker(void *arg)
+{
+	unsigned int i;
+
+	for (;;) {
+		pthread_mutex_lock(&next_lock);
+		i = next_preload++;
+		pthread_mutex_unlock(&next_lock);
+		if (i >= batch_count)
+			break;
+		prv_scan_obj(batch[i]);
+	}
+
+	return NULL;
+}
+
+static unsigned int prv_hash_fname(const char *fname)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*fname) {
+		hash ^= (uint8_t)*fname++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+ * Returns the slot holding fname, or the empty slot in which it belongs.
+ */
+
+static unsigned int *prv_find_slot(const char *fname)
+{
+	unsigned int i = prv_hash_fname(fname) & index_mask;
+	unsigned int slot;
+
+	while ((slot = pending_index[i])) {
+		if ((slot != SALINK_PRELOAD_TAKEN) &&
+		    !strcmp(pending[slot - 1]->fname, fname))
+			break;
+		i = (i + 1) & index_mask;
+	}
+
+	return &pending_index[i];
+}
+
+/*
+ * Grows pending so that count more objects can be added.  The index is
+ * rebuilt without the objects that have been taken.
+ */
+
+static uint8_t prv_grow_pending(unsigned int count)
+{
+	salink_preload_t **new_pending;
+	unsigned int *new_index;
+	unsigned int new_max = pending_max * 2;
+	unsigned int slots = 16;
+	unsigned int i;
+
+	if (pending_count + count <= pending_max)
+		return 1;
+
+	if (new_max < pending_count + count)
+		new_max = pending_count + count;
+	while (slots < new_max * 2)
+		slots *= 2;
+	new_index = calloc(slots, sizeof(*new_index));
+	if (!new_index)
+		return 0;
+	new_pending = realloc(pending, new_max * sizeof(*pending));
+	if (!new_pending) {
+		free(new_index);
+		return 0;
+	}
+	pending = new_pending;
+	pending_max = new_max;
+
+	free(pending_index);
+	pending_index = new_index;
+	index_mask = slots - 1;
+	for (i = 0; i < pending_count; i++)
+		if (pending[i])
+			*prv_find_slot(pending[i]->fname) = i + 1;
+
+	return 1;
+}
+
+static unsigned int prv_thread_count(void)
+{
+	long cpus;
+
+	if (link_threads)
+		return link_threads;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (unsigned int)cpus : 1;
+}
+
+void salink_preload_objs(const char *const *fnames, unsigned int count)
+{
+	unsigned int i;
+	unsigned int first = pending_count;
+	unsigned int threads;
+	unsigned int started;
+	unsigned int *slot;
+	salink_preload_t *pre;
+	pthread_t *ids;
+
+	/*
+	 * Running out of memory here isn't an error.  Any files we fail
+	 * to preload will be loaded by salink_take_preload.
+	 */
+
+	if (!prv_grow_pending(count))
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (strlen(fnames[i]) > MAX_FNAME)
+			continue;
+		slot = prv_find_slot(fnames[i]);
+		if (*slot)
+			continue;
+		pre = calloc(1, sizeof(*pre));
+		if (!pre)
+			break;
+		strcpy(pre->fname, fnames[i]);
+		pending[pending_count++] = pre;
+		*slot = pending_count;
+	}
+
+	count = pending_count - first;
+	if (count == 0)
+		return;
+
+	/*
+	 * The calling thread does its share of the work, so we start one
+	 * fewer workers than we have threads.
+	 */
+
+	threads = prv_thread_count();
+	if (threads > count)
+		threads = count;
+	ids = malloc(threads * sizeof(*ids));
+	if (!ids)
+		threads = 1;
+
+	batch = &pending[first];
+	batch_count = count;
+	next_preload = 0;
+	for (started = 0; started + 1 < threads; started++)
+		if (pthread_create(&ids[started], NULL, prv_worker, NULL))
+			break;
+	(void)prv_worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+	free(ids);
+}
+
+salink_preload_t *salink_take_preload(const char *fname)
+{
+	unsigned int *slot;
+	salink_preload_t *pre;
+
+	if (pending_index) {
+		slot = prv_find_slot(fname);
+		if (*slot) {
+			pre = pending[*slot - 1];
+			pending[*slot - 1] = NULL;
+			*slot = SALINK_PRELOAD_TAKEN;
+			return pre;
+		}
+	}
+
+	pre = calloc(1, sizeof(*pre));
+	if (!pre)
+		return NULL;
+	strcpy(pre->fname, fname);
+	prv_scan_obj(pre);
+
+	return pre;
+}
+
+void salink_free_preload(salink_preload_t *pre)
+{
+	free(pre->state);
+	free(pre->records);
+	free(pre->offsets);
+	free(pre);
+}
+
+void salink_free_preloads(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < pending_count; i++)
+		if (pending[i])
+			salink_free_preload(pending[i]);
+	free(pending);
+	pending = NULL;
+	pending_count = 0;
+	pending_max = 0;
+	free(pending_index);
+	pending_index = NULL;
+	index_mask = 0;
+}
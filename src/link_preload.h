@@ -0,0 +1,71 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_PRELOAD_H
+#define LINK_PRELOAD_H
+
+#include "salink.h"
+
+/*
+ * Host only.  Object files are loaded, checksummed and scanned by a pool
+ * of worker threads before the linker needs them.  A worker records the
+ * lines of each object that define labels, EQUs, ORGs, alignments and
+ * includes, together with the offset of each line from the start of the
+ * object.  The linker then takes these records, one object at a time and
+ * in the same order in which it would have loaded the objects, and adds
+ * them to the labels and globals arrays.  Nothing that depends on the
+ * order in which objects are processed is done by the workers.
+ *
+ * bad_line is the index of an incbin whose file could not be sized.
+ * The records stop at this line, size holds the object's size up to
+ * the line and the linker is expected to reproduce the error itself.
+ * If err is set the file could not be loaded at all.
+ */
+
+#define SALINK_NO_LINE 0xffff
+
+struct salink_preload_t_ {
+	char fname[MAX_FNAME + 1];
+	specasm_error_t err;
+	specasm_state_t *state;
+	uint16_t *records;
+	uint16_t *offsets;
+	uint16_t num_records;
+	uint16_t size;
+	uint16_t bad_line;
+};
+
+typedef struct salink_preload_t_ salink_preload_t;
+
+/*
+ * Starts loading the named files in parallel and waits for them all to
+ * be loaded.  Names that are too long or that are already loaded are
+ * ignored.
+ */
+
+void salink_preload_objs(const char *const *fnames, unsigned int count);
+
+/*
+ * Returns the preloaded object for fname, loading it on the calling
+ * thread if needed.  The caller owns the returned object.  Returns
+ * NULL if we run out of memory.
+ */
+
+salink_preload_t *salink_take_preload(const char *fname);
+void salink_free_preload(salink_preload_t *pre);
+void salink_free_preloads(void);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_reach.h"
+#include "link_refs.h"
+
+/*
+ * Objects that have been reached but not yet scanned.  An object is
+ * only ever pushed once, when its excluded flag is cleared, so a stack
+ * with room for every object can't overflow.
+ */
+
+static salink_obj_index_t *pending;
+static unsigned int pending_count;
+
+static void prv_reach(salink_obj_index_t index)
+{
+	salink_obj_t *obj = &obj_files[index];
+
+	if (!obj->excluded)
+		return;
+	obj->excluded = 0;
+	pending[pending_count++] = index;
+}
+
+/*
+ * Unknown globals are ignored here.  They'll be reported when the
+ * object that refers to them is linked.
+ */
+
+static void prv_reach_ref_e(const char *name)
+{
+	salink_global_t *global = salink_find_global(name);
+
+	if (global)
+		prv_reach(global->obj_index);
+}
+
+static uint8_t prv_is_test_file(const char *fname)
+{
+	const char *period = strrchr(fname, '.');
+
+	return period && ((period[1] | 32) == 't') && !period[2];
+}
+
+void salink_drop_unused_e(salink_obj_index_t main_index)
+{
+	salink_obj_index_t i;
+	uint16_t j;
+	salink_obj_t *obj;
+
+	pending = malloc(obj_file_count * sizeof(*pending));
+	if (!pending) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return;
+	}
+
+	for (i = 0; i < obj_file_count; i++)
+		obj_files[i].excluded = 1;
+
+	pending_count = 0;
+	prv_reach(main_index);
+	if (link_mode == SALINK_MODE_TEST)
+		for (i = 0; i < obj_file_count; i++)
+			if (prv_is_test_file(obj_files[i].fname))
+				prv_reach(i);
+
+	while (pending_count > 0) {
+		obj = &obj_files[pending[--pending_count]];
+		salink_load_obj_e(obj);
+		if (err_type != SPECASM_ERROR_OK)
+			goto cleanup;
+		for (j = 0; j < state.lines.num_lines; j++) {
+			salink_scan_line_refs_e(&state.lines.lines[j],
+						prv_reach_ref_e);
+			if (err_type != SPECASM_ERROR_OK)
+				goto cleanup;
+		}
+	}
+
+cleanup:
+	free(pending);
+	pending = NULL;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_REACH_H
+#define LINK_REACH_H
+
+#include "salink.h"
+
+/*
+ * Host only.  Sets the excluded flag of every object that can't be
+ * reached, by following references to globals, from the object that
+ * defines Main or, when building the test binary, from the .t files.
+ * Excluded objects are not written to the binary and are listed at the
+ * end of the map file.  Leaves any one of the objects in state.
+ */
+
+void salink_drop_unused_e(salink_obj_index_t main_index);
+
+#endif
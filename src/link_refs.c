@@ -0,0 +1,115 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <string.h>
+
+#include "expression.h"
+#include "link_refs.h"
+
+static void prv_ref_e(const char *name, salink_ref_fn_t fn)
+{
+	if ((name[0] >= 'A') && (name[0] <= 'Z'))
+		fn(name);
+}
+
+const char *salink_next_ident(const char *str, char *name)
+{
+	const char *start;
+	char c;
+	size_t len;
+
+	while ((c = *str) != 0) {
+		if (c == '\'') {
+			str++;
+			if (str[0] && str[1] == '\'')
+				str += 2;
+		} else if ((c == '$') || ((c >= '0') && (c <= '9'))) {
+			for (str++; ((*str >= '0') && (*str <= '9')) ||
+				    ((*str | 32) >= 'a' && (*str | 32) <= 'f');
+			     str++)
+				;
+		} else if ((c == '_') || ((c | 32) >= 'a' && (c | 32) <= 'z')) {
+			start = str;
+			for (str++; (*str == '_') ||
+				    ((*str >= '0') && (*str <= '9')) ||
+				    ((*str | 32) >= 'a' && (*str | 32) <= 'z');
+			     str++)
+				;
+			len = str - start;
+			if (len > SPECASM_LINE_MAX_LEN)
+				continue;
+			memcpy(name, start, len);
+			name[len] = 0;
+			return str;
+		} else {
+			str++;
+		}
+	}
+
+	return NULL;
+}
+
+static void prv_scan_exp_refs_e(const char *str, salink_ref_fn_t fn)
+{
+	char name[SPECASM_LINE_MAX_LEN + 1];
+
+	while ((str = salink_next_ident(str, name)) != NULL) {
+		prv_ref_e(name, fn);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+}
+
+void salink_scan_line_refs_e(const specasm_line_t *line, salink_ref_fn_t fn)
+{
+	const char *str;
+	uint8_t addr_type;
+	uint8_t id;
+
+	if (line->type == SPECASM_LINE_TYPE_EQU) {
+		str = salink_get_label_str_e(line->data.op_code[3],
+					     line->data.op_code[2]);
+		if (err_type == SPECASM_ERROR_OK)
+			prv_scan_exp_refs_e(str, fn);
+		return;
+	}
+
+	if (line->type >= SPECASM_LINE_TYPE_EXP_ADJ) {
+		str = salink_get_expression_str_e(line);
+		if (err_type == SPECASM_ERROR_OK)
+			prv_scan_exp_refs_e(str, fn);
+		return;
+	}
+
+	switch (line->type) {
+	case SPECASM_LINE_TYPE_DW:
+	case SPECASM_LINE_TYPE_CALL:
+	case SPECASM_LINE_TYPE_JP:
+	case SPECASM_LINE_TYPE_LD:
+		addr_type = specasm_line_get_addr_type(line);
+		if ((addr_type != SPECASM_FLAGS_ADDR_SHORT) &&
+		    (addr_type != SPECASM_FLAGS_ADDR_LONG))
+			break;
+		id = line->data.op_code[specasm_line_get_size(line) - 1];
+		str = salink_get_label_str_e(
+		    id, addr_type == SPECASM_FLAGS_ADDR_LONG ? 1 : 0);
+		if (err_type == SPECASM_ERROR_OK)
+			prv_ref_e(str, fn);
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_REFS_H
+#define LINK_REFS_H
+
+#include "salink.h"
+
+/*
+ * Host only.  Calls fn with the name of each global that line, from the
+ * object currently loaded into state, refers to.  Globals are referred to
+ * by the address operands of instructions and data, and by expressions,
+ * including the expressions of EQUs.  fn may set err_type to stop the
+ * scan.
+ */
+
+typedef void (*salink_ref_fn_t)(const char *name);
+
+/*
+ * Copies the next identifier in the expression str into name, which must
+ * have room for SPECASM_LINE_MAX_LEN + 1 characters, and returns a pointer
+ * to the character that follows it.  Characters and numbers, which may
+ * contain letters, are skipped.  Returns NULL if there are no more
+ * identifiers.
+ */
+
+const char *salink_next_ident(const char *str, char *name);
+
+void salink_scan_line_refs_e(const specasm_line_t *line, salink_ref_fn_t fn);
+
+#endif
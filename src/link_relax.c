@@ -0,0 +1,389 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_obj.h"
+#include "link_relax.h"
+
+/*
+ * The sites of each object are stored contiguously in sites, starting at
+ * first.  size is the size of the object before relaxation.
+ */
+
+struct prv_relax_obj_t_ {
+	unsigned int first;
+	unsigned int count;
+	uint16_t size;
+};
+typedef struct prv_relax_obj_t_ prv_relax_obj_t;
+
+static salink_relax_site_t *sites;
+static unsigned int site_count;
+static unsigned int site_max;
+static prv_relax_obj_t *objs;
+static unsigned int objs_count;
+static uint16_t *saved_offs;
+
+static void prv_no_memory(void)
+{
+	strcpy(error_buf, "Out of memory");
+	err_type = SALINK_ERROR_NO_MEMORY;
+}
+
+static uint8_t prv_assembled_size(uint8_t type)
+{
+	return type == SPECASM_LINE_TYPE_JP ? 3 : 2;
+}
+
+static uint8_t prv_long_size(uint8_t type)
+{
+	return type == SPECASM_LINE_TYPE_DJNZ ? 4 : 3;
+}
+
+static void prv_add_site_e(uint16_t line, uint16_t off, uint16_t target,
+			   uint8_t type)
+{
+	salink_relax_site_t *new_sites;
+	salink_relax_site_t *site;
+	unsigned int new_max;
+
+	if (site_count == site_max) {
+		new_max = site_max ? site_max * 2 : 64;
+		new_sites = realloc(sites, new_max * sizeof(*sites));
+		if (!new_sites) {
+			prv_no_memory();
+			return;
+		}
+		sites = new_sites;
+		site_max = new_max;
+	}
+
+	site = &sites[site_count++];
+	site->line = line;
+	site->off = off;
+	site->target = target;
+	site->type = type;
+	site->size = 2;
+}
+
+/*
+ * Relative jumps can only target local labels.  jps can also target
+ * globals, as long as they're not EQUs.  Returns SALINK_NO_LABEL if the
+ * target can't be found, in which case the line is left alone and any
+ * error is reported when it's linked.
+ */
+
+static uint16_t prv_find_target(salink_obj_t *obj, specasm_line_t *line,
+				uint8_t id)
+{
+	uint8_t addr_type = specasm_line_get_addr_type(line);
+	uint16_t index;
+	const char *str;
+	salink_global_t *global;
+
+	if (addr_type == SPECASM_FLAGS_ADDR_LONG)
+		index = id < SPECASM_MAX_LONG_STRINGS ? obj->long_labels[id]
+						      : SALINK_NO_LABEL;
+	else if (addr_type == SPECASM_FLAGS_ADDR_SHORT)
+		index = id < SPECASM_MAX_SHORT_STRINGS ? obj->short_labels[id]
+						       : SALINK_NO_LABEL;
+	else
+		return SALINK_NO_LABEL;
+
+	if ((index != SALINK_NO_LABEL) || (line->type != SPECASM_LINE_TYPE_JP))
+		return index;
+
+	str = salink_get_label_str_e(id, addr_type == SPECASM_FLAGS_ADDR_LONG
+						 ? SALINK_LABEL_TYPE_LNG
+						 : SALINK_LABEL_TYPE_SHORT);
+	if (err_type != SPECASM_ERROR_OK) {
+		err_type = SPECASM_ERROR_OK;
+		return SALINK_NO_LABEL;
+	}
+	global = salink_find_global(str);
+	if (!global ||
+	    (labels[global->label_index].type > SALINK_LABEL_TYPE_LNG))
+		return SALINK_NO_LABEL;
+
+	return global->label_index;
+}
+
+static void prv_collect_obj_e(salink_obj_t *obj)
+{
+	uint16_t i;
+	uint16_t target;
+	uint16_t off = 0;
+	uint8_t id;
+	specasm_line_t *line;
+	uint8_t narrow = link_flags & SALINK_FLAG_RELAX_SIZE;
+
+	for (i = 0; i < state.lines.num_lines; i++) {
+		line = &state.lines.lines[i];
+		if ((line->type == SPECASM_LINE_TYPE_INC_BIN_SHORT) ||
+		    (line->type == SPECASM_LINE_TYPE_INC_BIN_LONG)) {
+			off = salink_inc_bin_size_e(line, off);
+			if (err_type != SPECASM_ERROR_OK)
+				return;
+			continue;
+		}
+
+		target = SALINK_NO_LABEL;
+		if ((line->type == SPECASM_LINE_TYPE_JR) ||
+		    (line->type == SPECASM_LINE_TYPE_DJNZ)) {
+			target = prv_find_target(obj, line,
+						 line->data.op_code[1]);
+		} else if (narrow && (line->type == SPECASM_LINE_TYPE_JP) &&
+			   (line->data.op_code[0] == 0xc3)) {
+			id = specasm_line_get_size(line) - 1;
+			target = prv_find_target(obj, line,
+						 line->data.op_code[id]);
+		}
+		if (target != SALINK_NO_LABEL) {
+			prv_add_site_e(i, off, target, line->type);
+			if (err_type != SPECASM_ERROR_OK)
+				return;
+		}
+
+		off += specasm_compute_line_size(line);
+	}
+}
+
+void salink_relax_collect_e(const salink_obj_index_t *order,
+			    unsigned int label_count)
+{
+	unsigned int i;
+	salink_obj_index_t index;
+	salink_obj_t *obj;
+	prv_relax_obj_t *robj;
+
+	salink_relax_free();
+
+	objs = calloc(obj_file_count, sizeof(*objs));
+	saved_offs = malloc((label_count + 1) * sizeof(*saved_offs));
+	if (!objs || !saved_offs) {
+		prv_no_memory();
+		return;
+	}
+	objs_count = obj_file_count;
+	for (i = 0; i < label_count; i++)
+		saved_offs[i] = labels[i].data.off;
+
+	for (i = 0; i < obj_file_count; i++) {
+		index = order[i];
+		obj = &obj_files[index];
+		robj = &objs[index];
+		robj->size = obj->size;
+		if (salink_obj_excluded(obj))
+			continue;
+		salink_load_obj_e(obj);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+		robj->first = site_count;
+		prv_collect_obj_e(obj);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+		robj->count = site_count - robj->first;
+	}
+}
+
+void salink_relax_layout_e(void)
+{
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+	salink_obj_t *obj;
+	salink_label_t *label;
+	prv_relax_obj_t *robj;
+	salink_relax_site_t *site;
+	int delta;
+	uint16_t off;
+
+	for (i = 0; i < objs_count; i++) {
+		obj = &obj_files[i];
+		robj = &objs[i];
+		site = robj->count ? &sites[robj->first] : NULL;
+		k = 0;
+		delta = 0;
+		for (j = obj->label_start; j < obj->label_end; j++) {
+			label = &labels[j];
+			if (label->type > SALINK_LABEL_TYPE_ALIGN)
+				continue;
+			off = saved_offs[j];
+			for (; (k < robj->count) && (site[k].off < off); k++)
+				delta += site[k].size -
+					 prv_assembled_size(site[k].type);
+			label->data.off = off + delta;
+		}
+		for (; k < robj->count; k++)
+			delta += site[k].size -
+				 prv_assembled_size(site[k].type);
+
+		if (robj->size + delta > 0xffff) {
+			snprintf(error_buf, sizeof(error_buf),
+				 "%s past end of memory", obj->fname);
+			err_type = SALINK_ERROR_PROGRAM_TOO_BIG;
+			return;
+		}
+		obj->size = robj->size + delta;
+	}
+}
+
+static uint8_t prv_widen_site(salink_relax_site_t *site, uint16_t addr)
+{
+	int32_t diff;
+
+	if (site->size != 2)
+		return 0;
+	diff = (int32_t)labels[site->target].data.off - addr;
+	if ((diff >= -126) && (diff <= 129))
+		return 0;
+	site->size = prv_long_size(site->type);
+
+	return 1;
+}
+
+/*
+ * Checks the sites of robj, starting at *k, whose relaxed offsets are
+ * below limit.  real_off is the address of the object plus the padding
+ * added by the aligns that have already been passed.
+ */
+
+static uint8_t prv_widen_sites(prv_relax_obj_t *robj, unsigned int *k,
+			       int *delta, unsigned int limit,
+			       unsigned int real_off)
+{
+	salink_relax_site_t *site;
+	unsigned int off;
+	uint8_t widened = 0;
+
+	for (; *k < robj->count; (*k)++) {
+		site = &sites[robj->first + *k];
+		off = site->off + *delta;
+		if (off >= limit)
+			break;
+		*delta += site->size - prv_assembled_size(site->type);
+		widened |= prv_widen_site(site, real_off + off);
+	}
+
+	return widened;
+}
+
+/*
+ * The address of each site is the address of its object, plus its
+ * relaxed offset in the object, plus any padding inserted by the aligns
+ * that precede it.  Sites are checked against the layout computed before
+ * any of them were widened.
+ */
+
+uint8_t salink_relax_widen(void)
+{
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+	salink_obj_t *obj;
+	salink_label_t *label;
+	prv_relax_obj_t *robj;
+	unsigned int real_off;
+	unsigned int align;
+	unsigned int adjust;
+	int delta;
+	uint8_t widened = 0;
+
+	for (i = 0; i < objs_count; i++) {
+		obj = &obj_files[i];
+		robj = &objs[i];
+		if (!robj->count)
+			continue;
+		real_off = obj->addr;
+		k = 0;
+		delta = 0;
+		for (j = obj->label_start; j < obj->label_end; j++) {
+			label = &labels[j];
+			if (label->type != SALINK_LABEL_TYPE_ALIGN)
+				continue;
+			widened |= prv_widen_sites(robj, &k, &delta,
+						   label->data.off, real_off);
+			align = 1 << label->id;
+			adjust = (real_off + label->data.off) & (align - 1);
+			if (adjust > 0)
+				real_off += align - adjust;
+		}
+		widened |= prv_widen_sites(robj, &k, &delta, UINT_MAX,
+					   real_off);
+	}
+
+	return widened;
+}
+
+static int prv_site_cmp(const void *a, const void *b)
+{
+	const uint16_t *line = (const uint16_t *)a;
+	const salink_relax_site_t *site = (const salink_relax_site_t *)b;
+
+	return (int)*line - (int)site->line;
+}
+
+const salink_relax_site_t *salink_relax_find(salink_obj_index_t index,
+					     uint16_t line)
+{
+	prv_relax_obj_t *robj;
+	const salink_relax_site_t *site;
+
+	if (index >= objs_count)
+		return NULL;
+	robj = &objs[index];
+	if (!robj->count)
+		return NULL;
+	site = bsearch(&line, &sites[robj->first], robj->count,
+		       sizeof(*sites), prv_site_cmp);
+	if (!site || (site->size == prv_assembled_size(site->type)))
+		return NULL;
+
+	return site;
+}
+
+int salink_relax_saved(void)
+{
+	unsigned int i;
+	int saved = 0;
+
+	for (i = 0; i < site_count; i++)
+		saved += prv_assembled_size(sites[i].type) - sites[i].size;
+
+	return saved;
+}
+
+void salink_relax_free(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < objs_count; i++)
+		obj_files[i].size = objs[i].size;
+
+	free(sites);
+	sites = NULL;
+	site_count = 0;
+	site_max = 0;
+	free(objs);
+	objs = NULL;
+	objs_count = 0;
+	free(saved_offs);
+	saved_offs = NULL;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_RELAX_H
+#define LINK_RELAX_H
+
+#include "salink.h"
+
+/*
+ * Host only.  Branch relaxation.
+ *
+ * A site is a jr, djnz or, when optimising for size, an unconditional jp
+ * to a label.  Each site starts out in its short, two byte, form.  Sites
+ * whose targets turn out to be out of range are widened, jr to jp and
+ * djnz to dec b; jp nz.  A widened site is never narrowed again so the
+ * layout is guaranteed to settle.
+ *
+ * off is the offset of the site within its object before relaxation and
+ * target is the index of the label it jumps to.
+ */
+
+struct salink_relax_site_t_ {
+	uint16_t line;
+	uint16_t off;
+	uint16_t target;
+	uint8_t type;
+	uint8_t size;
+};
+typedef struct salink_relax_site_t_ salink_relax_site_t;
+
+/*
+ * Finds the sites of all the objects that are to be linked, in the order
+ * they're to be linked, and saves the offsets of the first label_count
+ * labels.  Leaves any one of the objects in state.
+ */
+
+void salink_relax_collect_e(const salink_obj_index_t *order,
+			    unsigned int label_count);
+
+/*
+ * Resets the labels and the sizes of the objects to account for the
+ * current sizes of the sites.  The label offsets are left relative to
+ * their objects, ready to be made absolute by the linker.
+ */
+
+void salink_relax_layout_e(void);
+
+/*
+ * Called once the label offsets are absolute.  Widens the sites that
+ * can't reach their targets.  Returns 1 if any were widened, in which
+ * case the layout needs to be recomputed.
+ */
+
+uint8_t salink_relax_widen(void);
+
+/*
+ * Returns the site for the given line of the given object if it has to be
+ * written in a different form to the one in which it was assembled,
+ * otherwise NULL.
+ */
+
+const salink_relax_site_t *salink_relax_find(salink_obj_index_t index,
+					     uint16_t line);
+
+/*
+ * The number of bytes saved by relaxation.  Negative if the program has
+ * grown.
+ */
+
+int salink_relax_saved(void);
+
+/*
+ * Restores the original sizes of the objects and frees the sites.
+ */
+
+void salink_relax_free(void);
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <time.h>
+
+#include "link_stats.h"
+#include "salink.h"
+
+salink_stats_t link_stats;
+
+static const char *const phase_names[SALINK_PHASE_MAX] = {
+    "scan", "layout", "equs", "write", "map", "total",
+};
+
+static uint64_t prv_now_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void salink_stats_start(unsigned int phase)
+{
+	link_stats.phase_start[phase] = prv_now_ns();
+}
+
+void salink_stats_stop(unsigned int phase)
+{
+	link_stats.phase_ns[phase] +=
+	    prv_now_ns() - link_stats.phase_start[phase];
+}
+
+unsigned long salink_stats_state_bytes(void)
+{
+	return sizeof(specasm_obj_header_t) +
+	       state.lines.num_lines * sizeof(specasm_line_t) +
+	       state.short_strs.num_strings * SPECASM_MAX_SHORT_LEN +
+	       state.long_strs.num_strings * SPECASM_MAX_LONG_LEN +
+	       sizeof(uint16_t);
+}
+
+static double prv_ms(unsigned int phase)
+{
+	return link_stats.phase_ns[phase] / 1000000.0;
+}
+
+void salink_stats_print(FILE *f)
+{
+	unsigned int i;
+
+	fprintf(f, "Phase        ms\n");
+	for (i = 0; i < SALINK_PHASE_MAX; i++)
+		fprintf(f, "%-8s %9.3f\n", phase_names[i], prv_ms(i));
+	fprintf(f, "Passes            %lu\n", link_stats.passes);
+	fprintf(f, "Objects parsed    %lu\n", link_stats.objs_parsed);
+	fprintf(f, "Objects loaded    %lu\n", link_stats.objs_loaded);
+	fprintf(f, "Bytes read        %lu\n", link_stats.bytes_read);
+	fprintf(f, "Bytes written     %lu\n", link_stats.bytes_written);
+	fprintf(f, "Label lookups     %lu\n", link_stats.label_lookups);
+	fprintf(f, "Expressions       %lu\n", link_stats.exp_evals);
+}
+
+void salink_stats_write_json_e(const char *fname)
+{
+	unsigned int i;
+	FILE *f;
+
+	f = fopen(fname, "w");
+	if (!f) {
+		err_type = SPECASM_ERROR_OPEN;
+		return;
+	}
+
+	fprintf(f, "{\n  \"time_ms\": {");
+	for (i = 0; i < SALINK_PHASE_MAX; i++)
+		fprintf(f, "%s\n    \"%s\": %.3f", i ? "," : "",
+			phase_names[i], prv_ms(i));
+	fprintf(f, "\n  },\n");
+	fprintf(f, "  \"passes\": %lu,\n", link_stats.passes);
+	fprintf(f, "  \"objects_parsed\": %lu,\n", link_stats.objs_parsed);
+	fprintf(f, "  \"objects_loaded\": %lu,\n", link_stats.objs_loaded);
+	fprintf(f, "  \"bytes_read\": %lu,\n", link_stats.bytes_read);
+	fprintf(f, "  \"bytes_written\": %lu,\n", link_stats.bytes_written);
+	fprintf(f, "  \"label_lookups\": %lu,\n", link_stats.label_lookups);
+	fprintf(f, "  \"expression_evals\": %lu\n}\n", link_stats.exp_evals);
+
+	if (fclose(f))
+		err_type = SPECASM_ERROR_WRITE;
+}
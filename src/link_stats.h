@@ -0,0 +1,89 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <stdint.h>
+
+/*
+ * On the host salink times each phase of the link and counts the work it
+ * does, so that the cost of a link can be tracked over time.  The totals
+ * cover all the passes of the link.  On the Spectrum the macros below
+ * compile to nothing.
+ *
+ * SALINK_PHASE_SCAN
+ *   Reading the directory and parsing the object files.
+ * SALINK_PHASE_LAYOUT
+ *   Ordering the objects and computing the addresses of their labels.
+ * SALINK_PHASE_EQUS
+ *   Evaluating the global EQUs.
+ * SALINK_PHASE_WRITE
+ *   Writing the binary.
+ * SALINK_PHASE_MAP
+ *   Writing the map file.
+ * SALINK_PHASE_TOTAL
+ *   The whole link.
+ */
+
+#define SALINK_PHASE_SCAN 0
+#define SALINK_PHASE_LAYOUT 1
+#define SALINK_PHASE_EQUS 2
+#define SALINK_PHASE_WRITE 3
+#define SALINK_PHASE_MAP 4
+#define SALINK_PHASE_TOTAL 5
+#define SALINK_PHASE_MAX 6
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+#include <stdio.h>
+
+struct salink_stats_t_ {
+	uint64_t phase_ns[SALINK_PHASE_MAX];
+	uint64_t phase_start[SALINK_PHASE_MAX];
+	unsigned long passes;
+	unsigned long objs_parsed;
+	unsigned long objs_loaded;
+	unsigned long bytes_read;
+	unsigned long bytes_written;
+	unsigned long label_lookups;
+	unsigned long exp_evals;
+};
+typedef struct salink_stats_t_ salink_stats_t;
+
+extern salink_stats_t link_stats;
+
+#define salink_stats_count(counter, n) (link_stats.counter += (n))
+
+void salink_stats_start(unsigned int phase);
+void salink_stats_stop(unsigned int phase);
+
+/*
+ * Returns the number of bytes an object file holding the object
+ * currently in state occupies on disk.
+ */
+
+unsigned long salink_stats_state_bytes(void);
+
+void salink_stats_print(FILE *f);
+void salink_stats_write_json_e(const char *fname);
+#else
+#define salink_stats_count(counter, n)
+#define salink_stats_start(phase)
+#define salink_stats_stop(phase)
+#endif
+
+#endif
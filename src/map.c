@@ -14,9 +14,13 @@
  * limitations under the License.
 */
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include <stdio.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
 
+#include "link_stats.h"
 #include "map.h"
 #include "peer.h"
 #include "salink.h"
@@ -30,6 +34,7 @@ static void prv_write_buffered_e(specasm_handle_t f, const char *str)
 		specasm_file_write_e(f, buf.file_buf, buf_count);
 		if (err_type != SPECASM_ERROR_OK)
 			return;
+		salink_stats_count(bytes_written, buf_count);
 		buf_count = 0;
 	}
 	memcpy(&buf.file_buf[buf_count], str, len);
@@ -42,7 +47,7 @@ static void prv_dump_globals_e(specasm_handle_t f, salink_global_t *glob,
 	char ibuf[16];
 	uint8_t type = labels[glob->label_index].type;
 
-	if (type > SALINK_LABEL_TYPE_LNG)
+	if ((type > SALINK_LABEL_TYPE_LNG) || salink_obj_excluded(obj))
 		return;
 
 	ibuf[0] = '$';
@@ -70,13 +75,276 @@ static void prv_dump_globals_e(specasm_handle_t f, salink_global_t *glob,
 	prv_write_buffered_e(f, "\n");
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * The symbols collected for the binary symbol file.  name is an offset
+ * into sym_strs and obj the index of the object in the file's object
+ * table.
+ */
+
+struct prv_sym_t_ {
+	uint32_t name;
+	uint16_t addr;
+	uint16_t obj;
+	uint16_t line;
+	uint8_t global;
+};
+typedef struct prv_sym_t_ prv_sym_t;
+
+static prv_sym_t *syms;
+static unsigned int sym_count;
+static unsigned int sym_max;
+static char *sym_strs;
+static uint32_t sym_strs_size;
+static uint32_t sym_strs_max;
+static salink_obj_index_t *sym_objs;
+static uint16_t sym_obj_count;
+
+static void *prv_grow_e(void *table, unsigned int *max, unsigned int count,
+			size_t size)
+{
+	void *new_table;
+	unsigned int new_max = *max ? *max : 256;
+
+	if (count <= *max)
+		return table;
+	while (new_max < count)
+		new_max *= 2;
+	new_table = realloc(table, new_max * size);
+	if (!new_table) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return NULL;
+	}
+	*max = new_max;
+
+	return new_table;
+}
+
+static uint32_t prv_add_sym_str_e(const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t off = sym_strs_size;
+	unsigned int max = sym_strs_max;
+	char *new_strs;
+
+	new_strs = prv_grow_e(sym_strs, &max, sym_strs_size + len, 1);
+	if (!new_strs)
+		return 0;
+	sym_strs = new_strs;
+	sym_strs_max = max;
+	memcpy(&sym_strs[off], str, len);
+	sym_strs_size += len;
+
+	return off;
+}
+
+static void prv_add_sym_e(const char *str, uint16_t addr, uint16_t line)
+{
+	prv_sym_t *new_syms;
+	prv_sym_t *sym;
+
+	new_syms = prv_grow_e(syms, &sym_max, sym_count + 1, sizeof(*syms));
+	if (!new_syms)
+		return;
+	syms = new_syms;
+
+	sym = &syms[sym_count];
+	sym->name = prv_add_sym_str_e(str);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+	sym->addr = addr;
+	sym->obj = sym_obj_count - 1;
+	sym->line = line;
+	sym->global = (str[0] >= 'A') && (str[0] <= 'Z');
+	sym_count++;
+}
+
+static int prv_sym_cmp(const void *a, const void *b)
+{
+	const prv_sym_t *a_s = (const prv_sym_t *)a;
+	const prv_sym_t *b_s = (const prv_sym_t *)b;
+
+	if (a_s->addr != b_s->addr)
+		return a_s->addr < b_s->addr ? -1 : 1;
+	if (a_s->global != b_s->global)
+		return a_s->global ? -1 : 1;
+
+	return strcmp(&sym_strs[a_s->name], &sym_strs[b_s->name]);
+}
+
+static void prv_put16(FILE *f, uint16_t v)
+{
+	fputc(v & 0xff, f);
+	fputc(v >> 8, f);
+}
+
+static void prv_put32(FILE *f, uint32_t v)
+{
+	prv_put16(f, v & 0xffff);
+	prv_put16(f, v >> 16);
+}
+
+/*
+ * The symbol file is named after the map file, <name>.sym for the main
+ * binary and <name>.tsm for the test binary.  See map.h for its format.
+ */
+
+static void prv_write_syms_e(void)
+{
+	FILE *f;
+	unsigned int i;
+	int failed;
+	salink_obj_t *obj;
+	uint32_t obj_names;
+	char sym_name[MAX_FNAME + 5];
+	char *period;
+
+	strcpy(sym_name, map_name);
+	period = strrchr(sym_name, '.');
+	if (period)
+		*period = 0;
+	strcat(sym_name, link_mode == SALINK_MODE_TEST ? ".tsm" : ".sym");
+
+	qsort(syms, sym_count, sizeof(*syms), prv_sym_cmp);
+
+	/*
+	 * The names of the objects follow the names of the symbols in the
+	 * string table.
+	 */
+
+	obj_names = sym_strs_size;
+	for (i = 0; i < sym_obj_count; i++) {
+		(void)prv_add_sym_str_e(obj_files[sym_objs[i]].fname);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+
+	f = fopen(sym_name, "wb");
+	if (!f) {
+		snprintf(error_buf, sizeof(error_buf), "Can't open %s",
+			 sym_name);
+		err_type = SALINK_ERROR_CANT_OPEN;
+		return;
+	}
+
+	fputs("SSYM", f);
+	prv_put16(f, SPECASM_SYM_VERSION);
+	prv_put16(f, sym_obj_count);
+	prv_put32(f, sym_count);
+	prv_put32(f, SPECASM_SYM_HEADER_SIZE +
+			 sym_obj_count * SPECASM_SYM_OBJ_SIZE +
+			 sym_count * SPECASM_SYM_SYM_SIZE);
+
+	for (i = 0; i < sym_obj_count; i++) {
+		obj = &obj_files[sym_objs[i]];
+		prv_put16(f, obj->addr);
+		prv_put16(f, obj->end);
+		prv_put32(f, obj_names);
+		obj_names += strlen(obj->fname) + 1;
+	}
+
+	for (i = 0; i < sym_count; i++) {
+		prv_put16(f, syms[i].addr);
+		prv_put16(f, syms[i].obj);
+		prv_put16(f, syms[i].line);
+		fputc(syms[i].global, f);
+		fputc(0, f);
+		prv_put32(f, syms[i].name);
+	}
+
+	(void)fwrite(sym_strs, 1, sym_strs_size, f);
+
+	failed = ferror(f);
+	if (fclose(f) || failed) {
+		snprintf(error_buf, sizeof(error_buf), "Can't write %s",
+			 sym_name);
+		err_type = SALINK_ERROR_CANT_OPEN;
+	}
+}
+
+static void prv_free_syms(void)
+{
+	free(syms);
+	syms = NULL;
+	sym_count = 0;
+	sym_max = 0;
+	free(sym_strs);
+	sym_strs = NULL;
+	sym_strs_size = 0;
+	sym_strs_max = 0;
+	free(sym_objs);
+	sym_objs = NULL;
+	sym_obj_count = 0;
+}
+
+/*
+ * Writes the range of addresses occupied by the object, its size and the
+ * padding added by its aligns.
+ */
+
+static void prv_dump_obj_range_e(specasm_handle_t f, salink_obj_t *obj)
+{
+	char line[64];
+	uint16_t span = obj->end - obj->addr;
+
+	snprintf(line, sizeof(line), "Start $%x End $%x Size %u Padding %u\n",
+		 obj->addr, obj->end, obj->size, span - obj->size);
+	prv_write_buffered_e(f, line);
+}
+
+/*
+ * Labels are added in the order in which they appear in their object so
+ * the line of each label is the next label line in the object.
+ */
+
+static uint16_t prv_next_label_line(uint16_t *cursor)
+{
+	uint8_t type;
+
+	while (*cursor < state.lines.num_lines) {
+		type = state.lines.lines[*cursor].type;
+		if ((type == SPECASM_LINE_TYPE_LL) ||
+		    (type == SPECASM_LINE_TYPE_SL))
+			return (*cursor)++;
+		++*cursor;
+	}
+
+	return 0;
+}
+
+static void prv_dump_excluded_e(specasm_handle_t f)
+{
+	salink_obj_index_t of;
+	uint8_t header = 0;
+
+	for (of = 0; of < obj_file_count; of++) {
+		if (!salink_obj_excluded(&obj_files[of]))
+			continue;
+		if (!header) {
+			prv_write_buffered_e(f, "\nExcluded\n-------\n");
+			if (err_type != SPECASM_ERROR_OK)
+				return;
+			header = 1;
+		}
+		prv_write_buffered_e(f, obj_files[of].fname);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+		prv_write_buffered_e(f, "\n");
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+	}
+}
+#endif
+
 #ifdef SPECASM_NEXT_BANKED
 void specasm_write_map_banked_e(void)
 #else
 void specasm_write_map_e(void)
 #endif
 {
-	uint8_t of;
+	salink_obj_index_t of;
 	unsigned int i;
 	specasm_handle_t f;
 	salink_global_t *glob;
@@ -84,6 +352,11 @@ void specasm_write_map_e(void)
 	salink_label_t *label;
 	const char *str;
 	char ibuf[16];
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	uint8_t full = link_flags & SALINK_FLAG_MAP_FULL;
+	uint16_t cursor = 0;
+	uint16_t line_no;
+#endif
 
 	ibuf[0] = '$';
 
@@ -94,6 +367,18 @@ void specasm_write_map_e(void)
 	if (err_type != SPECASM_ERROR_OK)
 		return;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (full) {
+		prv_free_syms();
+		sym_objs = malloc((obj_file_count + 1) * sizeof(*sym_objs));
+		if (!sym_objs) {
+			strcpy(error_buf, "Out of memory");
+			err_type = SALINK_ERROR_NO_MEMORY;
+			goto on_error;
+		}
+	}
+#endif
+
 	buf_count = 0;
 	prv_write_buffered_e(f, "Globals\n-------\n");
 	for (i = 0; i < global_count; i++) {
@@ -122,7 +407,9 @@ void specasm_write_map_e(void)
 					 SPECASM_CODE_COLOUR);
 
 		obj = &obj_files[of];
-		specasm_load_e(obj->fname);
+		if (salink_obj_excluded(obj))
+			continue;
+		salink_load_obj_e(obj);
 		if (err_type != SPECASM_ERROR_OK)
 			return;
 
@@ -135,6 +422,15 @@ void specasm_write_map_e(void)
 		prv_write_buffered_e(f, "\n-------\n");
 		if (err_type != SPECASM_ERROR_OK)
 			goto on_error;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		if (full) {
+			prv_dump_obj_range_e(f, obj);
+			if (err_type != SPECASM_ERROR_OK)
+				goto on_error;
+			sym_objs[sym_obj_count++] = of;
+			cursor = 0;
+		}
+#endif
 		for (i = obj->label_start; i < obj->label_end; i++) {
 			label = &labels[i];
 			if (label->type > SALINK_LABEL_TYPE_LNG)
@@ -152,26 +448,60 @@ void specasm_write_map_e(void)
 			prv_write_buffered_e(f, str);
 			if (err_type != SPECASM_ERROR_OK)
 				goto on_error;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+			if (full) {
+				line_no = prv_next_label_line(&cursor);
+				prv_add_sym_e(str, label->data.off, line_no);
+				if (err_type != SPECASM_ERROR_OK)
+					goto on_error;
+				prv_write_buffered_e(f, " line ");
+				if (err_type != SPECASM_ERROR_OK)
+					goto on_error;
+				itoa(line_no, &ibuf[1], 10);
+				prv_write_buffered_e(f, &ibuf[1]);
+				if (err_type != SPECASM_ERROR_OK)
+					goto on_error;
+			}
+#endif
 			prv_write_buffered_e(f, "\n");
 			if (err_type != SPECASM_ERROR_OK)
 				goto on_error;
 		}
 	}
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	prv_dump_excluded_e(f);
+	if (err_type != SPECASM_ERROR_OK)
+		goto on_error;
+#endif
+
 	if (buf_count > 0) {
 		specasm_file_write_e(f, buf.file_buf, buf_count);
 		if (err_type != SPECASM_ERROR_OK)
 			goto on_error;
+		salink_stats_count(bytes_written, buf_count);
 	}
 
 	specasm_file_close_e(f);
 	if (err_type != SPECASM_ERROR_OK)
 		goto on_error;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (full) {
+		prv_write_syms_e();
+		prv_free_syms();
+		if (err_type != SPECASM_ERROR_OK)
+			specasm_remove_file(image_name);
+	}
+#endif
+
 	return;
 
 on_error:
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	prv_free_syms();
+#endif
 	specasm_file_close_e(f);
 	specasm_remove_file(image_name);
 
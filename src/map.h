@@ -17,6 +17,39 @@
 #ifndef SPECASM_WRITE_MAP_H
 #define SPECASM_WRITE_MAP_H
 
+/*
+ * On the host, when SALINK_FLAG_MAP_FULL is set, the map also lists the
+ * address range, size and align padding of each object and the line of
+ * each label, and a binary symbol file is written alongside it.
+ *
+ * The symbol file is little endian and laid out as follows.
+ *
+ * - A 16 byte header
+ *   - "SSYM"
+ *   - 2 byte version, SPECASM_SYM_VERSION
+ *   - 2 byte number of objects
+ *   - 4 byte number of symbols
+ *   - 4 byte offset of the string table
+ * - An 8 byte record for each object in the binary
+ *   - 2 byte start address
+ *   - 2 byte end address, the address of the following object
+ *   - 4 byte offset of the object's name in the string table
+ * - A 12 byte record for each label, sorted by address, with the globals
+ *   at an address before the locals
+ *   - 2 byte address
+ *   - 2 byte index of the label's object in the object records
+ *   - 2 byte line number
+ *   - 1 byte, 1 if the label is global, 0 otherwise
+ *   - 1 byte reserved
+ *   - 4 byte offset of the label's name in the string table
+ * - The string table, a sequence of null terminated strings
+ */
+
+#define SPECASM_SYM_VERSION 1
+#define SPECASM_SYM_HEADER_SIZE 16
+#define SPECASM_SYM_OBJ_SIZE 8
+#define SPECASM_SYM_SYM_SIZE 12
+
 void specasm_write_map_e(void);
 
 #endif
@@ -0,0 +1,191 @@
+#!/bin/sh
+
+# Generates the perfect hash tables used by specasm_find_mnemomic() from
+# the mnemomics_table in line_common.c, once for the 48k mnemomics and
+# once for the Next mnemomics, and replaces the tables in line_common.c
+# with the new ones.  With -c the file is left alone and the script fails
+# if the tables in it are out of date.
+#
+# Usage: mnemomic_hash.sh [-c] path/to/line_common.c
+#
+# The hash of a mnemomic is h = h * 33 + c, on 16 bits.  Its bucket is
+# h & 31 and its slot is ((h >> 5) + mnemomics_disp[bucket]) & 127.  The
+# buckets are filled largest first, and each is given the smallest
+# displacement that moves all its mnemomics into free slots.
+
+set -e
+
+check=0
+if [ "$1" = "-c" ]; then
+    check=1
+    shift
+fi
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 [-c] line_common.c" >&2
+    exit 1
+fi
+
+src="$1"
+tmp="$src.tmp"
+trap 'rm -f "$tmp"' EXIT
+
+awk '
+function ord_init(i) {
+    for (i = 32; i < 127; i++)
+        ord[sprintf("%c", i)] = i
+}
+
+function hash(s, i, h) {
+    h = 0
+    for (i = 1; i <= length(s); i++)
+        h = (h * 33 + ord[substr(s, i, 1)]) % 65536
+    return h
+}
+
+# Builds the tables for the n mnemomics in keys and prints them.
+
+function emit(keys, n, i, j, b, d, s, ok, size, max, nb, found) {
+    split("", bucket_size); split("", bucket_keys)
+    split("", order); split("", disp); split("", slots)
+    nb = 0
+    for (i = 0; i < n; i++) {
+        h[i] = hash(keys[i])
+        b = h[i] % 32
+        if (!(b in bucket_size)) {
+            order[nb++] = b
+            bucket_size[b] = 0
+        }
+        bucket_keys[b, bucket_size[b]++] = i
+    }
+    for (b = 0; b < 32; b++)
+        disp[b] = 0
+    for (s = 0; s < 128; s++)
+        slots[s] = 0
+
+    max = 0
+    for (i = 0; i < nb; i++)
+        if (bucket_size[order[i]] > max)
+            max = bucket_size[order[i]]
+
+    for (size = max; size > 0; size--) {
+        for (i = 0; i < nb; i++) {
+            b = order[i]
+            if (bucket_size[b] != size)
+                continue
+            found = 0
+            for (d = 0; d < 128 && !found; d++) {
+                ok = 1
+                split("", taken)
+                for (j = 0; j < size && ok; j++) {
+                    s = (int(h[bucket_keys[b, j]] / 32) + d) % 128
+                    if (slots[s] || (s in taken))
+                        ok = 0
+                    taken[s] = 1
+                }
+                if (!ok)
+                    continue
+                for (j = 0; j < size; j++) {
+                    s = (int(h[bucket_keys[b, j]] / 32) + d) % 128
+                    slots[s] = bucket_keys[b, j] + 1
+                }
+                disp[b] = d
+                found = 1
+            }
+            if (!found) {
+                print "No perfect hash found" > "/dev/stderr"
+                failed = 1
+                exit 1
+            }
+        }
+    }
+
+    print "const uint8_t mnemomics_disp[SPECASM_MNEMOMIC_BUCKETS] = {"
+    for (i = 0; i < 32; i += 8) {
+        line = "\t"
+        for (j = i; j < i + 8; j++)
+            line = line disp[j] ", "
+        sub(/ $/, "", line)
+        print line
+    }
+    print "};"
+    print ""
+    print "const uint8_t mnemomics_hash[SPECASM_MNEMOMIC_SLOTS] = {"
+    for (i = 0; i < 128; i += 16) {
+        line = "\t"
+        for (j = i; j < i + 16; j++)
+            line = line slots[j] ", "
+        sub(/ $/, "", line)
+        print line
+    }
+    print "};"
+}
+
+BEGIN {
+    ord_init()
+    state = "before"
+    nbase = 0
+    nfull = 0
+}
+
+state == "before" && /^const specasm_mnemomic_t mnemomics_table\[\]/ {
+    state = "table"
+    print
+    next
+}
+
+state == "table" {
+    if ($0 ~ /^#ifdef SPECASM_TARGET_NEXT_OPCODES/)
+        next_only = 1
+    else if ($0 ~ /^#endif/)
+        next_only = 0
+    else if ($0 ~ /^};/)
+        state = "after"
+    else if (match($0, /"[a-z0-9]+"/)) {
+        m = substr($0, RSTART + 1, RLENGTH - 2)
+        full[nfull++] = m
+        if (!next_only)
+            base[nbase++] = m
+    }
+    print
+    next
+}
+
+state == "after" && /^\/\* Begin generated by mnemomic_hash.sh/ {
+    print
+    print "#ifdef SPECASM_TARGET_NEXT_OPCODES"
+    emit(full, nfull)
+    print "#else"
+    emit(base, nbase)
+    print "#endif"
+    state = "generated"
+    next
+}
+
+state == "generated" {
+    if ($0 ~ /^\/\* End generated by mnemomic_hash.sh/) {
+        state = "done"
+        print
+    }
+    next
+}
+
+{ print }
+
+END {
+    if (!failed && (state != "done")) {
+        print "Tables not found in " FILENAME > "/dev/stderr"
+        exit 1
+    }
+}
+' "$src" > "$tmp"
+
+if [ $check -eq 1 ]; then
+    if ! cmp -s "$src" "$tmp"; then
+        echo "The mnemomic hash tables in $src are out of date." >&2
+        echo "Run make mnemomic_hash to rebuild them." >&2
+        exit 1
+    fi
+else
+    mv "$tmp" "$src"
+fi
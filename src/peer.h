@@ -33,6 +33,15 @@ void specasm_peer_write_state_e(const char *fname, uint16_t checksum);
 
 uint16_t specasm_peer_read_state_e(const char *fname);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+/*
+ * Reads a file stored offset bytes into fname.  Used to load the
+ * members of libraries.
+ */
+
+uint16_t specasm_peer_read_state_at_e(const char *fname, uint32_t offset);
+#endif
+
 void specasm_text_set_flash(uint8_t x, uint8_t y, uint8_t attr);
 
 void specasm_text_printch(char ch, uint8_t x, uint8_t y, uint8_t attr);
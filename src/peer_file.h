@@ -75,4 +75,14 @@ specasm_dir_t specasm_opendir_e(const char *fname);
 void specasm_file_stat_e(specasm_handle_t f, specasm_stat_t *buf);
 uint8_t specasm_file_isdir(const char *fname);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+/*
+ * Host only.  Appends the whole of in, which must not have been read
+ * from, to out without copying it through a user space buffer.  out is
+ * flushed first.  Returns the number of bytes copied.
+ */
+
+size_t specasm_file_copy_e(specasm_handle_t out, specasm_handle_t in);
+#endif
+
 #endif
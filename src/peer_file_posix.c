@@ -14,10 +14,23 @@
  * limitations under the License.
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "peer_file.h"
 
 #include "error.h"
 
+#if defined(__linux__) && defined(__GLIBC__) &&                                \
+    ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 27))
+#define SPECASM_HAVE_COPY_FILE_RANGE
+#endif
+
 specasm_handle_t specasm_file_wopen_e(const char *fname)
 {
 	specasm_handle_t f;
@@ -105,3 +118,94 @@ uint8_t specasm_file_isdir(const char *fname)
 
 	return buf.st_mode & S_IFDIR ? 1 : 0;
 }
+
+/*
+ * Used when copy_file_range isn't available or doesn't support the pair
+ * of files.  The input is mapped and written in one go.
+ */
+
+static size_t prv_copy_mmap_e(int out_fd, int in_fd, size_t size)
+{
+	void *data;
+	ssize_t written;
+	size_t done = 0;
+
+	if (size == 0)
+		return 0;
+
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+	if (data == MAP_FAILED) {
+		err_type = SPECASM_ERROR_READ;
+		return 0;
+	}
+
+	while (done < size) {
+		written = write(out_fd, (const char *)data + done, size - done);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			err_type = SPECASM_ERROR_WRITE;
+			break;
+		}
+		done += (size_t)written;
+	}
+	(void)munmap(data, size);
+
+	return done;
+}
+
+size_t specasm_file_copy_e(specasm_handle_t out, specasm_handle_t in)
+{
+	struct stat st;
+	int in_fd = fileno(in);
+	int out_fd = fileno(out);
+	size_t size;
+	size_t done = 0;
+#ifdef SPECASM_HAVE_COPY_FILE_RANGE
+	ssize_t copied;
+#endif
+
+	if (fflush(out)) {
+		err_type = SPECASM_ERROR_WRITE;
+		return 0;
+	}
+
+	if (fstat(in_fd, &st)) {
+		err_type = SPECASM_ERROR_READ;
+		return 0;
+	}
+	size = (size_t)st.st_size;
+
+#ifdef SPECASM_HAVE_COPY_FILE_RANGE
+	while (done < size) {
+		copied = copy_file_range(in_fd, NULL, out_fd, NULL, size - done,
+					 0);
+		if (copied > 0) {
+			done += (size_t)copied;
+			continue;
+		}
+		if (copied == 0)
+			break;
+		if (errno == EINTR)
+			continue;
+		if ((done == 0) && ((errno == EXDEV) || (errno == ENOSYS) ||
+				    (errno == EINVAL) || (errno == EOPNOTSUPP)))
+			break;
+		err_type = SPECASM_ERROR_WRITE;
+		return done;
+	}
+#endif
+
+	if (done == 0)
+		done = prv_copy_mmap_e(out_fd, in_fd, size);
+
+	/*
+	 * The data was written behind stdio's back.  Move the stream to
+	 * the new end of the file.
+	 */
+
+	if (fseek(out, 0, SEEK_END))
+		err_type = SPECASM_ERROR_WRITE;
+
+	return done;
+}
@@ -15,6 +15,7 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "peer.h"
 #include "state.h"
@@ -22,6 +23,10 @@
 void specasm_peer_write_state_e(const char *fname, uint16_t checksum)
 {
 	FILE *f;
+	specasm_obj_header_t hdr;
+	size_t lines_len;
+	size_t short_len;
+	size_t long_len;
 
 	f = fopen(fname, "w");
 	if (!f) {
@@ -29,7 +34,15 @@ void specasm_peer_write_state_e(const char *fname, uint16_t checksum)
 		return;
 	}
 
-	if (fwrite(&state, 1, sizeof(state), f) < sizeof(state)) {
+	specasm_obj_header_init(&hdr);
+	lines_len = hdr.num_lines * sizeof(specasm_line_t);
+	short_len = hdr.num_short * SPECASM_MAX_SHORT_LEN;
+	long_len = hdr.num_long * SPECASM_MAX_LONG_LEN;
+
+	if ((fwrite(&hdr, 1, sizeof(hdr), f) < sizeof(hdr)) ||
+	    (fwrite(cur_state.lines.lines, 1, lines_len, f) < lines_len) ||
+	    (fwrite(cur_state.short_strs.strs, 1, short_len, f) < short_len) ||
+	    (fwrite(cur_state.long_strs.strs, 1, long_len, f) < long_len)) {
 		err_type = SPECASM_ERROR_WRITE;
 		goto cleanup;
 	}
@@ -43,7 +56,56 @@ cleanup:
 		err_type = SPECASM_ERROR_WRITE;
 }
 
+static uint16_t prv_read_state_e(FILE *f)
+{
+	uint16_t checksum = 0;
+	specasm_obj_header_t hdr;
+	size_t lines_len;
+	size_t short_len;
+	size_t long_len;
+
+	if (fread(&hdr, 1, sizeof(hdr), f) < sizeof(hdr)) {
+		err_type = SPECASM_ERROR_READ;
+		return 0;
+	}
+
+	if (!specasm_obj_header_apply_e(&hdr)) {
+		memcpy(&cur_state, &hdr, sizeof(hdr));
+		if (fread(((uint8_t *)&cur_state) + sizeof(hdr), 1,
+			  sizeof(state) - sizeof(hdr),
+			  f) < sizeof(state) - sizeof(hdr)) {
+			err_type = SPECASM_ERROR_READ;
+			return 0;
+		}
+	} else {
+		if (err_type != SPECASM_ERROR_OK)
+			return 0;
+		lines_len = hdr.num_lines * sizeof(specasm_line_t);
+		short_len = hdr.num_short * SPECASM_MAX_SHORT_LEN;
+		long_len = hdr.num_long * SPECASM_MAX_LONG_LEN;
+		if ((fread(cur_state.lines.lines, 1, lines_len, f) <
+		     lines_len) ||
+		    (fread(cur_state.short_strs.strs, 1, short_len, f) <
+		     short_len) ||
+		    (fread(cur_state.long_strs.strs, 1, long_len, f) <
+		     long_len)) {
+			err_type = SPECASM_ERROR_READ;
+			return 0;
+		}
+	}
+
+	if (fread(&checksum, 1, sizeof(checksum), f) < sizeof(checksum))
+		err_type = SPECASM_ERROR_READ;
+
+	return checksum;
+}
+
 uint16_t specasm_peer_read_state_e(const char *fname)
+{
+	return specasm_peer_read_state_at_e(fname, 0);
+}
+
+uint16_t specasm_peer_read_state_at_e(const char *fname, uint32_t offset)
 {
 	FILE *f;
 	uint16_t checksum = 0;
@@ -54,17 +116,11 @@ uint16_t specasm_peer_read_state_e(const char *fname)
 		return 0;
 	}
 
-	if (fread(&state, 1, sizeof(state), f) < sizeof(state)) {
+	if (offset && fseek(f, (long)offset, SEEK_SET))
 		err_type = SPECASM_ERROR_READ;
-		goto on_error;
-	}
-
-	if (fread(&checksum, 1, sizeof(checksum), f) < sizeof(checksum)) {
-		err_type = SPECASM_ERROR_READ;
-		goto on_error;
-	}
+	else
+		checksum = prv_read_state_e(f);
 
-on_error:
 	(void)fclose(f);
 
 	return checksum;
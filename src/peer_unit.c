@@ -18,9 +18,15 @@
 #include "state.h"
 #include <string.h>
 
+/*
+ * Holds a single object file, in the same format used by the other
+ * peers.
+ */
+
 struct peer_save_t_ {
-	uint16_t checksum;
-	uint8_t state[sizeof(state)];
+	uint16_t size;
+	uint8_t file[sizeof(specasm_obj_header_t) + sizeof(state) +
+		     sizeof(uint16_t)];
 };
 
 typedef struct peer_save_t_ peer_save_t;
@@ -35,35 +41,122 @@ typedef struct peer_save_t_ peer_save_t;
 static peer_save_t save_state;
 #endif
 
+static void prv_append(peer_save_t *save, const void *buf, uint16_t len)
+{
+	memcpy(&save->file[save->size], buf, len);
+	save->size += len;
+}
+
+static void prv_write(peer_save_t *save, uint16_t checksum)
+{
+	specasm_obj_header_t hdr;
+
+	specasm_obj_header_init(&hdr);
+	save->size = 0;
+	prv_append(save, &hdr, sizeof(hdr));
+	prv_append(save, cur_state.lines.lines,
+		   hdr.num_lines * sizeof(specasm_line_t));
+	prv_append(save, cur_state.short_strs.strs,
+		   hdr.num_short * SPECASM_MAX_SHORT_LEN);
+	prv_append(save, cur_state.long_strs.strs,
+		   hdr.num_long * SPECASM_MAX_LONG_LEN);
+	prv_append(save, &checksum, sizeof(checksum));
+}
+
+static const uint8_t *prv_take(const peer_save_t *save, uint16_t *pos,
+			       uint16_t len)
+{
+	const uint8_t *ptr = &save->file[*pos];
+
+	if (save->size - *pos < len) {
+		err_type = SPECASM_ERROR_READ;
+		return NULL;
+	}
+	*pos += len;
+
+	return ptr;
+}
+
+static uint16_t prv_read(const peer_save_t *save)
+{
+	specasm_obj_header_t hdr;
+	uint16_t checksum;
+	uint16_t pos = 0;
+	const uint8_t *ptr;
+
+	ptr = prv_take(save, &pos, sizeof(hdr));
+	if (!ptr)
+		return 0;
+	memcpy(&hdr, ptr, sizeof(hdr));
+
+	if (!specasm_obj_header_apply_e(&hdr)) {
+		ptr = prv_take(save, &pos, sizeof(state) - sizeof(hdr));
+		if (!ptr)
+			return 0;
+		memcpy(&cur_state, &save->file[0], sizeof(state));
+	} else {
+		if (err_type != SPECASM_ERROR_OK)
+			return 0;
+		ptr = prv_take(save, &pos,
+			       hdr.num_lines * sizeof(specasm_line_t));
+		if (!ptr)
+			return 0;
+		memcpy(cur_state.lines.lines, ptr,
+		       hdr.num_lines * sizeof(specasm_line_t));
+		ptr = prv_take(save, &pos,
+			       hdr.num_short * SPECASM_MAX_SHORT_LEN);
+		if (!ptr)
+			return 0;
+		memcpy(cur_state.short_strs.strs, ptr,
+		       hdr.num_short * SPECASM_MAX_SHORT_LEN);
+		ptr = prv_take(save, &pos, hdr.num_long * SPECASM_MAX_LONG_LEN);
+		if (!ptr)
+			return 0;
+		memcpy(cur_state.long_strs.strs, ptr,
+		       hdr.num_long * SPECASM_MAX_LONG_LEN);
+	}
+
+	ptr = prv_take(save, &pos, sizeof(checksum));
+	if (!ptr)
+		return 0;
+	memcpy(&checksum, ptr, sizeof(checksum));
+
+	return checksum;
+}
+
 #if defined(SPECASM_NEXT_BANKED) || defined(SPECASM_128_BANKED)
 void specasm_peer_write_state_banked_e(const char *fname, uint16_t checksum)
 {
-	peer_save_t *save_state = (peer_save_t *) 0xc000;
-
-	save_state->checksum = checksum;
-	memcpy(&save_state->state, &state, sizeof(state));
+	prv_write((peer_save_t *)0xc000, checksum);
 }
 
 #else
 void specasm_peer_write_state_e(const char *fname, uint16_t checksum)
 {
-	save_state.checksum = checksum;
-	memcpy(&save_state.state, &state, sizeof(state));
+	prv_write(&save_state, checksum);
 }
 #endif
 
 #if defined(SPECASM_NEXT_BANKED) || defined(SPECASM_128_BANKED)
 uint16_t specasm_peer_read_state_banked_e(const char *fname)
 {
-	peer_save_t *save_state = (peer_save_t *) 0xc000;
-
-	memcpy(&state, &save_state->state, sizeof(state));
-	return save_state->checksum;
+	return prv_read((const peer_save_t *)0xc000);
 }
 #else
 uint16_t specasm_peer_read_state_e(const char *fname)
 {
-	memcpy(&state, &save_state.state, sizeof(state));
-	return save_state.checksum;
+	return prv_read(&save_state);
 }
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * There's only ever one file so the offset is ignored.
+ */
+
+uint16_t specasm_peer_read_state_at_e(const char *fname, uint32_t offset)
+{
+	return prv_read(&save_state);
+}
+#endif
 #endif
@@ -20,10 +20,33 @@
 #include <arch/zx/esxdos.h>
 #include <errno.h>
 #include <intrinsic.h>
+#include <string.h>
+
+/*
+ * Some of the sections of an object file may be empty, so we don't
+ * bother esxdos with them.
+ */
+
+static void prv_write_e(unsigned char f, const void *buf, uint16_t len)
+{
+	if (!len)
+		return;
+
+	(void)esxdos_f_write(f, buf, len);
+	if (errno)
+		err_type = SPECASM_ERROR_WRITE;
+}
+
+static void prv_read_e(unsigned char f, void *buf, uint16_t len)
+{
+	if (len && (esxdos_f_read(f, buf, len) < len))
+		err_type = SPECASM_ERROR_READ;
+}
 
 void specasm_peer_write_state_e(const char *fname, uint16_t checksum)
 {
 	unsigned char f;
+	specasm_obj_header_t hdr;
 
 	errno = 0;
 	f = esxdos_f_open(fname, ESXDOS_MODE_W | ESXDOS_MODE_OC);
@@ -32,15 +55,22 @@ void specasm_peer_write_state_e(const char *fname, uint16_t checksum)
 		return;
 	}
 
-	(void)esxdos_f_write(f, &state, sizeof(state));
-	if (errno) {
-		err_type = SPECASM_ERROR_WRITE;
+	specasm_obj_header_init(&hdr);
+	prv_write_e(f, &hdr, sizeof(hdr));
+	if (err_type != SPECASM_ERROR_OK)
 		goto cleanup;
-	}
-
-	(void)esxdos_f_write(f, &checksum, sizeof(checksum));
-	if (errno)
-		err_type = SPECASM_ERROR_WRITE;
+	prv_write_e(f, state.lines.lines, hdr.num_lines * sizeof(specasm_line_t));
+	if (err_type != SPECASM_ERROR_OK)
+		goto cleanup;
+	prv_write_e(f, state.short_strs.strs,
+		    hdr.num_short * SPECASM_MAX_SHORT_LEN);
+	if (err_type != SPECASM_ERROR_OK)
+		goto cleanup;
+	prv_write_e(f, state.long_strs.strs,
+		    hdr.num_long * SPECASM_MAX_LONG_LEN);
+	if (err_type != SPECASM_ERROR_OK)
+		goto cleanup;
+	prv_write_e(f, &checksum, sizeof(checksum));
 
 cleanup:
 	esxdos_f_close(f);
@@ -50,6 +80,7 @@ uint16_t specasm_peer_read_state_e(const char *fname)
 {
 	unsigned char f;
 	uint16_t checksum = 0;
+	specasm_obj_header_t hdr;
 
 	errno = 0;
 	f = esxdos_f_open(fname, ESXDOS_MODE_R);
@@ -58,15 +89,30 @@ uint16_t specasm_peer_read_state_e(const char *fname)
 		return 0;
 	}
 
-	if (esxdos_f_read(f, &state, sizeof(state)) < sizeof(state)) {
-		err_type = SPECASM_ERROR_READ;
+	prv_read_e(f, &hdr, sizeof(hdr));
+	if (err_type != SPECASM_ERROR_OK)
 		goto on_error;
-	}
 
-	if (esxdos_f_read(f, &checksum, sizeof(checksum)) < sizeof(checksum)) {
-		err_type = SPECASM_ERROR_READ;
-		goto on_error;
+	if (!specasm_obj_header_apply_e(&hdr)) {
+		memcpy(&state, &hdr, sizeof(hdr));
+		prv_read_e(f, ((uint8_t *)&state) + sizeof(hdr),
+			   sizeof(state) - sizeof(hdr));
+	} else if (err_type == SPECASM_ERROR_OK) {
+		prv_read_e(f, state.lines.lines,
+			   hdr.num_lines * sizeof(specasm_line_t));
+		if (err_type != SPECASM_ERROR_OK)
+			goto on_error;
+		prv_read_e(f, state.short_strs.strs,
+			   hdr.num_short * SPECASM_MAX_SHORT_LEN);
+		if (err_type != SPECASM_ERROR_OK)
+			goto on_error;
+		prv_read_e(f, state.long_strs.strs,
+			   hdr.num_long * SPECASM_MAX_LONG_LEN);
 	}
+	if (err_type != SPECASM_ERROR_OK)
+		goto on_error;
+
+	prv_read_e(f, &checksum, sizeof(checksum));
 
 on_error:
 	esxdos_f_close(f);
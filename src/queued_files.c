@@ -15,14 +15,82 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "peer.h"
 #include "queued_files.h"
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include "link_deps.h"
+#include "link_lib.h"
+#endif
 
 static void prv_add_queued_filename_e(const char *base, const char *prefix,
 				      const char *str);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+static char (*deferred_tests)[MAX_FNAME + 1];
+static unsigned int deferred_test_count;
+static unsigned int deferred_test_max;
+
+uint8_t salink_defer_test_e(const char *path)
+{
+	char(*new_tests)[MAX_FNAME + 1];
+	unsigned int new_max;
+	const char *period;
+
+	if (!(link_flags & SALINK_FLAG_SINGLE_PASS) ||
+	    (link_mode != SALINK_MODE_LINK))
+		return 0;
+
+	period = strrchr(path, '.');
+	if (!period || ((period[1] | 32) != 't') || period[2])
+		return 0;
+
+	if (deferred_test_count == deferred_test_max) {
+		new_max = deferred_test_max ? deferred_test_max * 2 : 16;
+		new_tests =
+		    realloc(deferred_tests, new_max * sizeof(*deferred_tests));
+		if (!new_tests) {
+			strcpy(error_buf, "Out of memory");
+			err_type = SALINK_ERROR_NO_MEMORY;
+			return 1;
+		}
+		deferred_tests = new_tests;
+		deferred_test_max = new_max;
+	}
+	strcpy(deferred_tests[deferred_test_count++], path);
+
+	return 1;
+}
+
+/*
+ * The queue is a stack, so the tests are pushed in reverse to be popped
+ * in the order in which they were deferred.
+ */
+
+void salink_queue_deferred_tests_e(void)
+{
+	unsigned int i;
+
+	salink_reserve_queued_files_e(queued_files + deferred_test_count);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+
+	for (i = deferred_test_count; i > 0; i--)
+		strcpy(salink_queued_fname(queued_files++),
+		       deferred_tests[i - 1]);
+}
+
+void salink_free_deferred_tests(void)
+{
+	free(deferred_tests);
+	deferred_tests = NULL;
+	deferred_test_count = 0;
+	deferred_test_max = 0;
+}
+#endif
+
 static uint8_t prv_add_queued_dir_e(const char *fname)
 {
 	specasm_dir_t dir;
@@ -52,6 +120,12 @@ static uint8_t prv_add_queued_dir_e(const char *fname)
 		return 0;
 	}
 
+	salink_deps_add_e(fname);
+	if (err_type != SPECASM_ERROR_OK) {
+		specasm_closedir(dir);
+		return 0;
+	}
+
 	strcpy(dir_name, fname);
 	ptr = &dir_name[fname_len];
 	ptr[0] = '/';
@@ -105,12 +179,18 @@ static void prv_add_queued_filename_e(const char *base, const char *prefix,
 	char *start;
 	char *slash;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	salink_reserve_queued_files_e(queued_files + 1);
+	if (err_type != SPECASM_ERROR_OK)
+		return;
+#else
 	if (queued_files == MAX_PENDING_X_FILES) {
 		snprintf(error_buf, sizeof(error_buf),
 			 "Pending file limit %d reached", MAX_PENDING_X_FILES);
 		err_type = SALINK_ERROR_TOO_MANY_FILES;
 		return;
 	}
+#endif
 
 	/*
 	 * Build up a path relative to the including path, providing
@@ -146,7 +226,7 @@ static void prv_add_queued_filename_e(const char *base, const char *prefix,
 		return;
 	}
 
-	ptr = &buf.fname[queued_files][0];
+	ptr = salink_queued_fname(queued_files);
 	start = ptr;
 	if (base_len) {
 		strncpy(ptr, base, base_len);
@@ -168,17 +248,33 @@ static void prv_add_queued_filename_e(const char *base, const char *prefix,
 	if (err_type != SPECASM_ERROR_OK)
 		return;
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (salink_lib_check_fname(start)) {
+		salink_deps_add_e(start);
+		if (err_type != SPECASM_ERROR_OK)
+			return;
+		salink_lib_add_e(start);
+		return;
+	}
+#endif
+
 	ptr = &start[space_needed - 2];
 
 	/*
 	 * .t files can be explicitly included but shouldn't be added to the
-	 * main binary.
+	 * main binary.  When linking in a single pass they're queued anyway
+	 * and set aside by salink_defer_test_e() when they're popped.
 	 */
 
 	if (ptr[0] == '.' && (ptr[1] | 32) == 't') {
 		if (link_mode == SALINK_MODE_LINK) {
 			got_test = 1;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+			if (!(link_flags & SALINK_FLAG_SINGLE_PASS))
+				return;
+#else
 			return;
+#endif
 		}
 	}
 	queued_files++;
@@ -22,4 +22,21 @@
 void salink_add_queued_file_e(const char *base, const char *prefix,
 			      specasm_line_t *line);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * When linking in a single pass, .t files included by the objects
+ * of the main binary are remembered so that they can be queued
+ * once we start building the test binary.  salink_defer_test_e() is
+ * called as each file is popped from the queue.  It returns 1 if the
+ * file is such a .t file and has been set aside.  Setting them aside
+ * in the order they're popped means that they're parsed in the same
+ * order as they would be by a separate link of the test binary.
+ */
+
+uint8_t salink_defer_test_e(const char *path);
+void salink_queue_deferred_tests_e(void);
+void salink_free_deferred_tests(void);
+#endif
+
 #endif
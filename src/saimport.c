@@ -16,16 +16,85 @@
 
 #include <stdio.h>
 #include <string.h>
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "peer.h"
 #include "peer_file.h"
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include "saimport_cache.h"
+#endif
 #include "state.h"
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * On the host the source file is mapped into memory, and lines are
+ * copied straight from the mapping into the line buffer.
+ */
+
+static SPECASM_THREAD_LOCAL const char *src_buf;
+static SPECASM_THREAD_LOCAL size_t src_len;
+static SPECASM_THREAD_LOCAL size_t src_ptr;
+#else
 #define MAX_BUFFER_SIZE 1024
 
-static char file_buf[MAX_BUFFER_SIZE];
-uint16_t bytes_in_buf;
-uint16_t ptr;
+static SPECASM_THREAD_LOCAL char file_buf[MAX_BUFFER_SIZE];
+SPECASM_THREAD_LOCAL uint16_t bytes_in_buf;
+SPECASM_THREAD_LOCAL uint16_t ptr;
+#endif
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * On the host, files can be imported on several threads at once.  Each
+ * file is a job.  Errors are stored in the job and are printed once all
+ * the jobs have finished, in the order in which the files were passed
+ * on the command line.  As with a serial import, only the first error
+ * is reported.
+ */
+
+#define SAIMPORT_MAX_MSG (SPECASM_PATH_MAX + 64)
+
+struct saimport_job_t_ {
+	const char *fname;
+	int cache_entry;
+	int failed;
+	char msg[SAIMPORT_MAX_MSG];
+};
+typedef struct saimport_job_t_ saimport_job_t;
+
+static SPECASM_THREAD_LOCAL saimport_job_t *cur_job;
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static saimport_job_t *jobs;
+static unsigned int job_count;
+static unsigned int next_job;
+static uint8_t job_failed;
+static unsigned int failed_job;
+static uint8_t use_cache;
+
+static void prv_error(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	if (cur_job)
+		vsnprintf(cur_job->msg, sizeof(cur_job->msg), fmt, ap);
+	else
+		vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+#else
+#define prv_error(...) fprintf(stderr, __VA_ARGS__)
+#endif
 
 static int prv_check_file(const char *fname, char *ext)
 {
@@ -46,11 +115,144 @@ static int prv_check_file(const char *fname, char *ext)
 	}
 
 on_error:
-	fprintf(stderr, ".s or .ts extension expected got %s\n", fname);
+	prv_error(".s or .ts extension expected got %s\n", fname);
 
 	return 1;
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * An empty file can't be mapped so it's left unmapped with a length of
+ * 0.
+ */
+
+static void prv_map_file_e(const char *fname)
+{
+	int fd;
+	struct stat st;
+	void *map;
+
+	src_buf = NULL;
+	src_len = 0;
+	src_ptr = 0;
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		err_type = SPECASM_ERROR_OPEN;
+		return;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		err_type = SPECASM_ERROR_READ;
+		goto cleanup;
+	}
+
+	if (st.st_size == 0)
+		goto cleanup;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		err_type = SPECASM_ERROR_READ;
+		goto cleanup;
+	}
+
+	src_buf = map;
+	src_len = st.st_size;
+
+cleanup:
+	(void)close(fd);
+}
+
+static void prv_unmap_file(void)
+{
+	if (src_buf)
+		(void)munmap((void *)src_buf, src_len);
+	src_buf = NULL;
+	src_len = 0;
+}
+
+/*
+ * Returns non-zero if any of the len bytes at str might be dropped by
+ * prv_get_line_e(), that is, if one of them is below ' ' or has its top
+ * bit set, and so may be negative.  The bytes are checked eight at a
+ * time.  Subtracting ' ' from each byte sets its top bit if it's below
+ * ' '.  A borrow can only leave a byte that's already been caught so
+ * there are no false negatives.
+ */
+
+static int prv_needs_filter(const char *str, size_t len)
+{
+	uint64_t w;
+	const uint64_t spaces = 0x2020202020202020ull;
+	const uint64_t tops = 0x8080808080808080ull;
+	uint8_t ch;
+
+	for (; len >= sizeof(w); len -= sizeof(w), str += sizeof(w)) {
+		memcpy(&w, str, sizeof(w));
+		if (((w - spaces) | w) & tops)
+			return 1;
+	}
+
+	while (len--) {
+		ch = (uint8_t)*str++;
+		if ((ch < ' ') || (ch & 0x80))
+			return 1;
+	}
+
+	return 0;
+}
+
+static uint8_t prv_get_line_e(char *buf, uint8_t *eof)
+{
+	const char *line = &src_buf[src_ptr];
+	const char *nl;
+	size_t len = src_len - src_ptr;
+	size_t i;
+	char ch;
+	uint8_t line_len = 0;
+
+	nl = len ? memchr(line, '\n', len) : NULL;
+	if (nl) {
+		len = nl - line;
+		src_ptr += len + 1;
+	} else {
+		src_ptr = src_len;
+	}
+	*eof = !nl;
+
+	/*
+	 * The carriage return of a DOS line ending would be dropped
+	 * anyway, so it's removed here to keep such lines on the fast
+	 * path.
+	 */
+
+	if (len && line[len - 1] == '\r')
+		len--;
+
+	if (!prv_needs_filter(line, len)) {
+		if (len > SPECASM_LINE_MAX_LEN) {
+			err_type = SPECASM_ERROR_NO_ROOM_IN_LINE;
+			return 0;
+		}
+		memcpy(buf, line, len);
+		return (uint8_t)len;
+	}
+
+	for (i = 0; i < len; i++) {
+		ch = line[i];
+		if (ch < ' ')
+			continue;
+		if (line_len == SPECASM_LINE_MAX_LEN) {
+			err_type = SPECASM_ERROR_NO_ROOM_IN_LINE;
+			return 0;
+		}
+		buf[line_len++] = ch;
+	}
+
+	return line_len;
+}
+#else
 static uint8_t prv_get_line_e(specasm_handle_t f, char *buf, uint8_t *eof)
 {
 	uint16_t read;
@@ -93,74 +295,106 @@ static uint8_t prv_get_line_e(specasm_handle_t f, char *buf, uint8_t *eof)
 		ptr = 0;
 	} while (1);
 }
+#endif
 
 static int prv_parse_file(const char *fname)
 {
 	uint8_t eof;
 	uint16_t linelen;
+#if defined(SPECTRUM) || defined(__ZXNEXT)
 	specasm_handle_t f;
+#endif
 	char buf[SPECASM_MAX_SCRATCH];
 	unsigned int cur_line = 0;
 	int retval = 1;
 
 	buf[SPECASM_LINE_MAX_LEN] = 0;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	prv_map_file_e(fname);
+#else
 	f = specasm_file_ropen_e(fname);
+#endif
 	if (err_type != SPECASM_ERROR_OK) {
-		fprintf(stderr, "Unable to open source file %s\n", fname);
+		prv_error("Unable to open source file %s\n", fname);
 		return 1;
 	}
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+	/*
+	 * Unused parts of the state are written to the object file.  Clear
+	 * them so that the file doesn't depend on what was imported before
+	 * it on the same thread.
+	 */
+
+	memset(&cur_state, 0, sizeof(state));
+	specasm_state_reset();
+#else
 	specasm_state_reset();
+	bytes_in_buf = 0;
+	ptr = 0;
+#endif
 
 	do {
 		memset(buf, ' ', SPECASM_LINE_MAX_LEN);
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		linelen = prv_get_line_e(buf, &eof);
+#else
 		linelen = prv_get_line_e(f, buf, &eof);
+#endif
 		if (err_type != SPECASM_ERROR_OK) {
-			fprintf(stderr, "Failed to read line: %s\n",
-				specasm_error_msg(err_type));
+			prv_error("Failed to read line: %s\n",
+				  specasm_error_msg(err_type));
 			goto cleanup;
 		}
 		if ((linelen == 0) && eof)
 			break;
 		specasm_append_empty_line_e();
 		if (err_type != SPECASM_ERROR_OK) {
-			fprintf(stderr, "%s\n", specasm_error_msg(err_type));
+			prv_error("%s\n", specasm_error_msg(err_type));
 			goto cleanup;
 		}
 		if (linelen > 0) {
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+			specasm_parse_line_fold_e(cur_line, buf);
+#else
 			specasm_parse_line_e(cur_line, buf);
+#endif
 			if (err_type != SPECASM_ERROR_OK) {
-				fprintf(stderr, "Syntax error at line %u: %s\n",
-					cur_line, specasm_error_msg(err_type));
+				prv_error("Syntax error at line %u: %s\n",
+					  cur_line, specasm_error_msg(err_type));
 				goto cleanup;
 			}
 #if !defined(SPECTRUM) && !defined(__ZXNEXT)
 			specasm_format_line_e(buf, cur_line);
 			if (err_type != SPECASM_ERROR_OK) {
-				fprintf(stderr, "format error at line %u: %s\n",
-					cur_line, specasm_error_msg(err_type));
+				prv_error("format error at line %u: %s\n",
+					  cur_line, specasm_error_msg(err_type));
 				goto cleanup;
 			}
 #endif
 		}
-		cur_line = state.lines.num_lines;
+		cur_line = cur_state.lines.num_lines;
 	} while (!eof);
 
 	retval = 0;
 cleanup:
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	prv_unmap_file();
+#else
 	specasm_file_close_e(f);
+#endif
 
 	return retval;
 }
 
-static int prv_write_object_file(const char *fname, char ext)
+static int prv_obj_fname(const char *fname, char ext, char *obj_file)
 {
-	char obj_file[SPECASM_PATH_MAX];
 	char *period;
 
 	if (strlen(fname) + 1 > SPECASM_PATH_MAX) {
-		fprintf(stderr, "Path to long\n");
+		prv_error("Path to long\n");
 		return 1;
 	}
 
@@ -174,39 +408,286 @@ static int prv_write_object_file(const char *fname, char ext)
 	period[1] = ext;
 	period[2] = 0;
 
+	return 0;
+}
+
+static int prv_write_object_file(const char *fname, char ext)
+{
+	char obj_file[SPECASM_PATH_MAX];
+
+	if (prv_obj_fname(fname, ext, obj_file))
+		return 1;
+
 	specasm_save_e(obj_file);
 	if (err_type != SPECASM_ERROR_OK) {
-		fprintf(stderr, "Failed to write %s: %s\n", obj_file,
-			specasm_error_msg(err_type));
+		prv_error("Failed to write %s: %s\n", obj_file,
+			  specasm_error_msg(err_type));
 		return 1;
 	}
 
 	return 0;
 }
 
-int main(int argc, char *argv[])
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * A serial import stops at the first file that fails, so a job that
+ * follows a failed job on the command line doesn't write its object
+ * file.  The job is marked as failed, without a message, so that its
+ * cache entry isn't updated.
+ */
+
+static int prv_skip_write(void)
+{
+	int skip;
+
+	if (!cur_job)
+		return 0;
+
+	pthread_mutex_lock(&job_lock);
+	skip = job_failed && ((unsigned int)(cur_job - jobs) > failed_job);
+	pthread_mutex_unlock(&job_lock);
+
+	return skip;
+}
+#endif
+
+static int prv_import_file(const char *fname)
 {
 	char ext;
 
-	if (argc < 2) {
-		fprintf(stderr, "Usage: saimport .s\n");
+	if (prv_check_file(fname, &ext))
+		return 1;
+
+	if (prv_parse_file(fname))
 		return 1;
-	}
 
 #if !defined(SPECTRUM) && !defined(__ZXNEXT)
-	specasm_init_dump_table();
+	if (prv_skip_write())
+		return 1;
 #endif
 
-	for (int i = 1; i < argc; i++) {
-		if (prv_check_file(argv[i], &ext))
-			return 1;
+	return prv_write_object_file(fname, ext);
+}
 
-		if (prv_parse_file(argv[i]))
-			return 1;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Skips the import if the source file and its object file haven't
+ * changed since the last time the source file was imported.
+ */
+
+static int prv_import_cached_file(const char *fname, int entry)
+{
+	char ext;
+	char obj_file[SPECASM_PATH_MAX];
+	uint64_t src_hash;
+
+	if (entry < 0)
+		return prv_import_file(fname);
+
+	if (prv_check_file(fname, &ext) || prv_obj_fname(fname, ext, obj_file))
+		return 1;
+
+	if (saimport_cache_hash_file(fname, &src_hash)) {
+		saimport_cache_invalidate(entry);
+		return prv_import_file(fname);
+	}
+
+	if (saimport_cache_fresh(entry, src_hash, obj_file))
+		return 0;
+
+	if (prv_import_file(fname)) {
+		saimport_cache_invalidate(entry);
+		return 1;
+	}
+
+	saimport_cache_update(entry, src_hash, obj_file);
 
-		if (prv_write_object_file(argv[i], ext))
+	return 0;
+}
+
+/*
+ * Jobs are handed out in order and no new jobs are started once one has
+ * failed.  All the jobs before a failed job are therefore guaranteed to
+ * have run, so the first error in command line order is always known.
+ * failed_job holds the index of the first job known to have failed.
+ */
+
+static void *prv_worker(void *arg)
+{
+	specasm_ctx_t *ctx = arg;
+	specasm_ctx_save_t save;
+	saimport_job_t *job;
+
+	specasm_ctx_init(ctx);
+	specasm_ctx_enter(ctx, &save);
+	for (;;) {
+		pthread_mutex_lock(&job_lock);
+		job = (job_failed || next_job == job_count) ? NULL
+							    : &jobs[next_job++];
+		pthread_mutex_unlock(&job_lock);
+		if (!job)
+			break;
+
+		cur_job = job;
+		err_type = SPECASM_ERROR_OK;
+		job->failed = prv_import_cached_file(job->fname,
+						     job->cache_entry);
+		cur_job = NULL;
+		if (job->failed) {
+			pthread_mutex_lock(&job_lock);
+			if (!job_failed ||
+			    ((unsigned int)(job - jobs) < failed_job))
+				failed_job = job - jobs;
+			job_failed = 1;
+			pthread_mutex_unlock(&job_lock);
+		}
+	}
+	specasm_ctx_leave(ctx, &save);
+
+	return NULL;
+}
+
+/*
+ * Each file gets its own cache entry.  If a file is named twice on the
+ * command line only the first instance uses the cache, so that no two
+ * threads update the same entry.
+ */
+
+static int prv_find_cache_entries(void)
+{
+	unsigned int i;
+	unsigned int j;
+	int entry;
+
+	for (i = 0; i < job_count; i++) {
+		jobs[i].cache_entry = -1;
+		if (!use_cache)
+			continue;
+		entry = saimport_cache_find(jobs[i].fname);
+		if (entry < 0)
 			return 1;
+		for (j = 0; j < i; j++)
+			if (jobs[j].cache_entry == entry)
+				break;
+		if (j == i)
+			jobs[i].cache_entry = entry;
+	}
+
+	return 0;
+}
+
+static int prv_import_files(char **fnames, unsigned int count,
+			    unsigned int threads)
+{
+	unsigned int i;
+	unsigned int started;
+	pthread_t *ids;
+	specasm_ctx_t *ctxs;
+	int retval = 1;
+
+	jobs = calloc(count, sizeof(*jobs));
+	ids = malloc(threads * sizeof(*ids));
+	ctxs = malloc(threads * sizeof(*ctxs));
+	if (!jobs || !ids || !ctxs) {
+		fprintf(stderr, "Out of memory\n");
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; i++)
+		jobs[i].fname = fnames[i];
+	job_count = count;
+
+	if (use_cache)
+		(void)saimport_cache_load(SAIMPORT_CACHE_FNAME);
+	if (prv_find_cache_entries()) {
+		fprintf(stderr, "Out of memory\n");
+		goto cleanup;
+	}
+
+	/*
+	 * The main thread imports files too, so we need one fewer worker
+	 * than we have threads.
+	 */
+
+	for (started = 0; started + 1 < threads; started++)
+		if (pthread_create(&ids[started], NULL, prv_worker,
+				   &ctxs[started + 1]))
+			break;
+	(void)prv_worker(&ctxs[0]);
+	for (i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+
+	if (use_cache && saimport_cache_save(SAIMPORT_CACHE_FNAME))
+		fprintf(stderr, "Failed to write %s\n", SAIMPORT_CACHE_FNAME);
+
+	for (i = 0; i < count; i++)
+		if (jobs[i].failed) {
+			fputs(jobs[i].msg, stderr);
+			goto cleanup;
+		}
+
+	retval = 0;
+
+cleanup:
+
+	saimport_cache_free();
+	free(ctxs);
+	free(ids);
+	free(jobs);
+
+	return retval;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	int first = 1;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (; first < argc && argv[first][0] == '-'; first++) {
+		if (!strcmp(argv[first], "--cache")) {
+			use_cache = 1;
+		} else if (!strcmp(argv[first], "-j") && first + 1 < argc) {
+			threads = atoi(argv[++first]);
+			if (threads < 1) {
+				fprintf(stderr, "Bad thread count %s\n",
+					argv[first]);
+				return 1;
+			}
+		} else {
+			break;
+		}
 	}
+#endif
+
+	if (argc < first + 1) {
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		fprintf(stderr,
+			"Usage: saimport [-j threads] [--cache] .s\n");
+#else
+		fprintf(stderr, "Usage: saimport .s\n");
+#endif
+		return 1;
+	}
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	specasm_init_dump_table();
+
+	if (threads > argc - first)
+		threads = argc - first;
+	if (threads < 1)
+		threads = 1;
+
+	return prv_import_files(&argv[first], argc - first,
+				(unsigned int)threads);
+#else
+	for (int i = first; i < argc; i++)
+		if (prv_import_file(argv[i]))
+			return 1;
 
 	return 0;
+#endif
 }
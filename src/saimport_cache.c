@@ -0,0 +1,250 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "saimport_cache.h"
+#include "state_base.h"
+
+/*
+ * Each line of the cache file has the form
+ *
+ * version source_hash object_hash path
+ *
+ * where the version and the hashes are in hex.  The path runs to the
+ * end of the line and so may contain spaces.
+ */
+
+#define SAIMPORT_CACHE_HEADER "# saimport cache 1\n"
+
+struct saimport_cache_entry_t_ {
+	char *path;
+	uint16_t version;
+	uint8_t valid;
+	uint64_t src_hash;
+	uint64_t obj_hash;
+};
+typedef struct saimport_cache_entry_t_ saimport_cache_entry_t;
+
+static saimport_cache_entry_t *entries;
+static int entry_count;
+static int entry_max;
+
+static int prv_add_entry(const char *path)
+{
+	saimport_cache_entry_t *new_entries;
+	saimport_cache_entry_t *e;
+	int new_max;
+
+	if (entry_count == entry_max) {
+		new_max = entry_max ? entry_max * 2 : 64;
+		new_entries = realloc(entries, new_max * sizeof(*entries));
+		if (!new_entries)
+			return -1;
+		entries = new_entries;
+		entry_max = new_max;
+	}
+
+	e = &entries[entry_count];
+	memset(e, 0, sizeof(*e));
+	e->path = strdup(path);
+	if (!e->path)
+		return -1;
+
+	return entry_count++;
+}
+
+int saimport_cache_load(const char *fname)
+{
+	FILE *f;
+	char line[1024];
+	unsigned int version;
+	uint64_t src_hash;
+	uint64_t obj_hash;
+	int pos;
+	int i;
+	size_t len;
+
+	/*
+	 * A missing or damaged cache isn't an error.  It just means that
+	 * everything is imported.
+	 */
+
+	f = fopen(fname, "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		len = strlen(line);
+		if (len == 0 || line[len - 1] != '\n' || line[0] == '#')
+			continue;
+		line[len - 1] = 0;
+		if (sscanf(line, "%x %" SCNx64 " %" SCNx64 " %n", &version,
+			   &src_hash, &obj_hash, &pos) != 3)
+			continue;
+		if (!line[pos])
+			continue;
+		i = prv_add_entry(&line[pos]);
+		if (i < 0) {
+			fclose(f);
+			return 1;
+		}
+		entries[i].version = (uint16_t)version;
+		entries[i].src_hash = src_hash;
+		entries[i].obj_hash = obj_hash;
+		entries[i].valid = 1;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+/*
+ * The cache is written to a temporary file which is then renamed, so
+ * that an interrupted import can't leave a truncated cache behind.
+ */
+
+int saimport_cache_save(const char *fname)
+{
+	FILE *f;
+	int i;
+	char tmp_name[1024];
+	saimport_cache_entry_t *e;
+
+	if (snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", fname) >=
+	    (int)sizeof(tmp_name))
+		return 1;
+
+	f = fopen(tmp_name, "w");
+	if (!f)
+		return 1;
+
+	(void)fputs(SAIMPORT_CACHE_HEADER, f);
+	for (i = 0; i < entry_count; i++) {
+		e = &entries[i];
+		if (!e->valid)
+			continue;
+		(void)fprintf(f, "%x %016" PRIx64 " %016" PRIx64 " %s\n",
+			      e->version, e->src_hash, e->obj_hash, e->path);
+	}
+
+	if (ferror(f)) {
+		(void)fclose(f);
+		goto on_error;
+	}
+
+	if (fclose(f))
+		goto on_error;
+
+	if (rename(tmp_name, fname))
+		goto on_error;
+
+	return 0;
+
+on_error:
+	(void)remove(tmp_name);
+	return 1;
+}
+
+void saimport_cache_free(void)
+{
+	int i;
+
+	for (i = 0; i < entry_count; i++)
+		free(entries[i].path);
+	free(entries);
+	entries = NULL;
+	entry_count = 0;
+	entry_max = 0;
+}
+
+int saimport_cache_find(const char *path)
+{
+	int i;
+
+	for (i = 0; i < entry_count; i++)
+		if (!strcmp(entries[i].path, path))
+			return i;
+
+	return prv_add_entry(path);
+}
+
+/*
+ * 64 bit FNV-1a.
+ */
+
+int saimport_cache_hash_file(const char *fname, uint64_t *hash)
+{
+	FILE *f;
+	uint8_t buf[4096];
+	size_t read;
+	size_t i;
+	uint64_t h = 0xcbf29ce484222325ull;
+	int retval = 1;
+
+	f = fopen(fname, "rb");
+	if (!f)
+		return 1;
+
+	while ((read = fread(buf, 1, sizeof(buf), f)) > 0)
+		for (i = 0; i < read; i++) {
+			h ^= buf[i];
+			h *= 0x100000001b3ull;
+		}
+
+	if (!ferror(f)) {
+		*hash = h;
+		retval = 0;
+	}
+	(void)fclose(f);
+
+	return retval;
+}
+
+uint8_t saimport_cache_fresh(int entry, uint64_t src_hash,
+			     const char *obj_fname)
+{
+	saimport_cache_entry_t *e = &entries[entry];
+	uint64_t obj_hash;
+
+	if (!e->valid || (e->version != SPECASM_VERSION) ||
+	    (e->src_hash != src_hash))
+		return 0;
+
+	if (saimport_cache_hash_file(obj_fname, &obj_hash))
+		return 0;
+
+	return obj_hash == e->obj_hash;
+}
+
+void saimport_cache_update(int entry, uint64_t src_hash,
+			   const char *obj_fname)
+{
+	saimport_cache_entry_t *e = &entries[entry];
+
+	e->valid = !saimport_cache_hash_file(obj_fname, &e->obj_hash);
+	e->src_hash = src_hash;
+	e->version = SPECASM_VERSION;
+}
+
+void saimport_cache_invalidate(int entry)
+{
+	entries[entry].valid = 0;
+}
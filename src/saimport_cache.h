@@ -0,0 +1,54 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef SAIMPORT_CACHE_H
+#define SAIMPORT_CACHE_H
+
+#include <stdint.h>
+
+/*
+ * Host only.  The cache is a text file that records, for each source
+ * file imported, the hash of the source, the version of Specasm that
+ * imported it and the hash of the object file written.  A source file
+ * does not need to be imported again if none of these have changed.
+ *
+ * Entries are added with saimport_cache_find(), which must not be
+ * called while other threads are using the cache.  The other functions
+ * only touch the entry they're passed and so can be called from
+ * multiple threads, provided no two threads share an entry.
+ */
+
+#define SAIMPORT_CACHE_FNAME ".saimport.cache"
+
+int saimport_cache_load(const char *fname);
+int saimport_cache_save(const char *fname);
+void saimport_cache_free(void);
+
+/*
+ * Returns the index of the entry for path, adding one if needed, or -1
+ * if we run out of memory.
+ */
+
+int saimport_cache_find(const char *path);
+
+int saimport_cache_hash_file(const char *fname, uint64_t *hash);
+uint8_t saimport_cache_fresh(int entry, uint64_t src_hash,
+			     const char *obj_fname);
+void saimport_cache_update(int entry, uint64_t src_hash,
+			   const char *obj_fname);
+void saimport_cache_invalidate(int entry);
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "salib.h"
+#include "state_base.h"
+
+struct salib_symbol_t_ {
+	uint16_t member;
+	char name[SPECASM_LINE_MAX_LEN + 1];
+};
+typedef struct salib_symbol_t_ salib_symbol_t;
+
+struct salib_file_t_ {
+	const char *path;
+	uint8_t *data;
+};
+typedef struct salib_file_t_ salib_file_t;
+
+static salib_member_t *members;
+static salib_file_t *files;
+static uint16_t member_count;
+static salib_symbol_t *symbols;
+static uint32_t symbol_count;
+static uint32_t symbol_max;
+
+static const uint8_t lib_magic[SALIB_MAGIC_LEN] = SALIB_MAGIC;
+
+static int prv_add_symbol(const char *name, uint16_t member)
+{
+	salib_symbol_t *new_symbols;
+	uint32_t new_max;
+
+	if (symbol_count == symbol_max) {
+		new_max = symbol_max ? symbol_max * 2 : 64;
+		new_symbols = realloc(symbols, new_max * sizeof(*symbols));
+		if (!new_symbols) {
+			fprintf(stderr, "Out of memory\n");
+			return 1;
+		}
+		symbols = new_symbols;
+		symbol_max = new_max;
+	}
+
+	symbols[symbol_count].member = member;
+	strcpy(symbols[symbol_count].name, name);
+	symbol_count++;
+
+	return 0;
+}
+
+/*
+ * The globals of an object are the labels and EQUs that begin with an
+ * upper case letter.
+ */
+
+static int prv_add_symbols(uint16_t member)
+{
+	uint16_t i;
+	specasm_line_t *line;
+	const char *str;
+
+	for (i = 0; i < state.lines.num_lines; i++) {
+		line = &state.lines.lines[i];
+		if (line->type == SPECASM_LINE_TYPE_LL)
+			str = specasm_state_get_long_e(line->data.label);
+		else if (line->type == SPECASM_LINE_TYPE_SL)
+			str = specasm_state_get_short_e(line->data.label);
+		else if (line->type == SPECASM_LINE_TYPE_EQU)
+			str = line->data.op_code[0] == SPECASM_LINE_TYPE_LL
+				  ? specasm_state_get_long_e(
+					line->data.op_code[1])
+				  : specasm_state_get_short_e(
+					line->data.op_code[1]);
+		else
+			continue;
+
+		if (err_type != SPECASM_ERROR_OK) {
+			fprintf(stderr, "%s: %s\n", files[member].path,
+				specasm_error_msg(err_type));
+			return 1;
+		}
+
+		if ((str[0] >= 'A') && (str[0] <= 'Z'))
+			if (prv_add_symbol(str, member))
+				return 1;
+	}
+
+	return 0;
+}
+
+static uint8_t *prv_read_file(const char *path, uint32_t *size)
+{
+	FILE *f;
+	long len;
+	uint8_t *data = NULL;
+
+	f = fopen(path, "r");
+	if (!f)
+		return NULL;
+
+	if (fseek(f, 0, SEEK_END) || ((len = ftell(f)) < 0) ||
+	    fseek(f, 0, SEEK_SET))
+		goto cleanup;
+
+	data = malloc(len + 1);
+	if (!data)
+		goto cleanup;
+
+	if (fread(data, 1, len, f) < (size_t)len) {
+		free(data);
+		data = NULL;
+		goto cleanup;
+	}
+	*size = (uint32_t)len;
+
+cleanup:
+	(void)fclose(f);
+
+	return data;
+}
+
+static int prv_add_member(const char *path, uint16_t member)
+{
+	const char *name;
+	const char *period;
+	uint16_t i;
+	salib_member_t *m = &members[member];
+
+	name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	period = strchr(name, '.');
+	if (!period || ((period[1] | 32) != 'x') || period[2]) {
+		fprintf(stderr, ".x extension expected got %s\n", path);
+		return 1;
+	}
+
+	if (strlen(name) > SALIB_MAX_MEMBER_NAME) {
+		fprintf(stderr, "%s is too long.  Max %d characters\n", name,
+			SALIB_MAX_MEMBER_NAME);
+		return 1;
+	}
+
+	for (i = 0; i < member; i++)
+		if (!strcmp(members[i].name, name)) {
+			fprintf(stderr, "%s and %s have the same name\n",
+				files[i].path, path);
+			return 1;
+		}
+
+	memset(m, 0, sizeof(*m));
+	strcpy(m->name, name);
+	files[member].path = path;
+
+	/*
+	 * Loading the file checks that it's a valid object file that was
+	 * written by a compatible version of Specasm.
+	 */
+
+	err_type = SPECASM_ERROR_OK;
+	specasm_load_e(path);
+	if (err_type != SPECASM_ERROR_OK) {
+		fprintf(stderr, "Failed to load %s: %s\n", path,
+			specasm_error_msg(err_type));
+		return 1;
+	}
+
+	if (prv_add_symbols(member))
+		return 1;
+
+	files[member].data = prv_read_file(path, &m->size);
+	if (!files[member].data) {
+		fprintf(stderr, "Unable to read %s\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int prv_symbol_cmp(const void *a, const void *b)
+{
+	return strcmp(((const salib_symbol_t *)a)->name,
+		      ((const salib_symbol_t *)b)->name);
+}
+
+static int prv_check_symbols(void)
+{
+	uint32_t i;
+	salib_symbol_t *a;
+	salib_symbol_t *b;
+
+	for (i = 1; i < symbol_count; i++) {
+		a = &symbols[i - 1];
+		b = &symbols[i];
+		if (!strcmp(a->name, b->name)) {
+			fprintf(stderr, "%s defined in %s and %s\n", a->name,
+				files[a->member].path, files[b->member].path);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int prv_write_lib(FILE *f)
+{
+	salib_header_t hdr;
+	uint32_t offset;
+	uint32_t i;
+	size_t len;
+
+	memcpy(hdr.magic, lib_magic, SALIB_MAGIC_LEN);
+	hdr.version = SALIB_VERSION;
+	hdr.num_members = member_count;
+	hdr.num_symbols = symbol_count;
+	hdr.index_size = 0;
+	for (i = 0; i < symbol_count; i++)
+		hdr.index_size += sizeof(uint16_t) + strlen(symbols[i].name) + 1;
+
+	offset = sizeof(hdr) + member_count * sizeof(*members) + hdr.index_size;
+	for (i = 0; i < member_count; i++) {
+		members[i].offset = offset;
+		offset += members[i].size;
+	}
+
+	if ((fwrite(&hdr, 1, sizeof(hdr), f) < sizeof(hdr)) ||
+	    (fwrite(members, sizeof(*members), member_count, f) < member_count))
+		return 1;
+
+	for (i = 0; i < symbol_count; i++) {
+		len = strlen(symbols[i].name) + 1;
+		if ((fwrite(&symbols[i].member, 1, sizeof(uint16_t), f) <
+		     sizeof(uint16_t)) ||
+		    (fwrite(symbols[i].name, 1, len, f) < len))
+			return 1;
+	}
+
+	for (i = 0; i < member_count; i++)
+		if (fwrite(files[i].data, 1, members[i].size, f) <
+		    members[i].size)
+			return 1;
+
+	return 0;
+}
+
+/*
+ * The library is written to a temporary file which is then renamed, so
+ * that a failure can't leave a truncated library behind.
+ */
+
+static int prv_save_lib(const char *fname)
+{
+	FILE *f;
+	char tmp_name[1024];
+
+	if (snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", fname) >=
+	    (int)sizeof(tmp_name)) {
+		fprintf(stderr, "Path too long\n");
+		return 1;
+	}
+
+	f = fopen(tmp_name, "w");
+	if (!f) {
+		fprintf(stderr, "Unable to open %s\n", tmp_name);
+		return 1;
+	}
+
+	if (prv_write_lib(f)) {
+		(void)fclose(f);
+		goto on_error;
+	}
+
+	if (fclose(f))
+		goto on_error;
+
+	if (rename(tmp_name, fname))
+		goto on_error;
+
+	return 0;
+
+on_error:
+	fprintf(stderr, "Unable to write %s\n", fname);
+	(void)remove(tmp_name);
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+	int retval = 1;
+
+	if ((argc < 3) || (argc - 2 > 0xffff)) {
+		fprintf(stderr, "Usage: salib lib .x [.x ...]\n");
+		return 1;
+	}
+
+	member_count = argc - 2;
+	members = calloc(member_count, sizeof(*members));
+	files = calloc(member_count, sizeof(*files));
+	if (!members || !files) {
+		fprintf(stderr, "Out of memory\n");
+		goto cleanup;
+	}
+
+	for (i = 0; i < member_count; i++)
+		if (prv_add_member(argv[i + 2], i))
+			goto cleanup;
+
+	qsort(symbols, symbol_count, sizeof(*symbols), prv_symbol_cmp);
+	if (prv_check_symbols())
+		goto cleanup;
+
+	retval = prv_save_lib(argv[1]);
+
+cleanup:
+	if (files)
+		for (i = 0; i < member_count; i++)
+			free(files[i].data);
+	free(files);
+	free(members);
+	free(symbols);
+
+	return retval;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright contributors to Specasm
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef SALIB_H
+#define SALIB_H
+
+#include <stdint.h>
+
+/*
+ * Host only.  A library is a single file that bundles a number of .x
+ * files.  It has the following layout.
+ *
+ * - A salib_header_t.
+ * - num_members salib_member_t entries, one for each .x file.
+ * - index_size bytes holding num_symbols entries, sorted by name.  Each
+ *   entry is a uint16_t holding the index of the member that defines
+ *   the global, followed by the global's null terminated name.
+ * - The .x files themselves, stored as they were on disk.  offset is
+ *   from the start of the library.
+ */
+
+#define SALIB_MAGIC_LEN 4
+#define SALIB_MAGIC {0xff, 'S', 'A', 'L'}
+#define SALIB_VERSION 1
+#define SALIB_MAX_MEMBER_NAME 23
+
+struct salib_header_t_ {
+	uint8_t magic[SALIB_MAGIC_LEN];
+	uint16_t version;
+	uint16_t num_members;
+	uint32_t num_symbols;
+	uint32_t index_size;
+};
+typedef struct salib_header_t_ salib_header_t;
+
+struct salib_member_t_ {
+	uint32_t offset;
+	uint32_t size;
+	char name[SALIB_MAX_MEMBER_NAME + 1];
+};
+typedef struct salib_member_t_ salib_member_t;
+
+#endif
@@ -23,7 +23,11 @@
 #endif
 
 #include "expression.h"
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#include "link_lib.h"
+#endif
 #include "link_obj.h"
+#include "link_stats.h"
 #include "map.h"
 #include "peer.h"
 #include "salink.h"
@@ -37,20 +41,62 @@ unsigned int bin_size;
 char image_name[MAX_FNAME + 1];
 char map_name[MAX_FNAME + 1];
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+salink_label_t *labels;
+salink_obj_t *obj_files;
+unsigned int obj_file_count;
+salink_global_t *globals;
+char (*queued_fnames)[MAX_FNAME + 1];
+unsigned int queued_files;
+
+static unsigned int label_max;
+static unsigned int obj_file_max;
+static unsigned int global_max;
+static unsigned int queued_file_max;
+#else
 salink_label_t labels[MAX_LABELS];
 salink_obj_t obj_files[MAX_FILES];
 uint8_t obj_file_count;
-uint8_t obj_files_order[MAX_FILES];
 salink_global_t globals[MAX_GLOBALS];
-unsigned int global_count;
 uint8_t queued_files;
+#endif
+unsigned int global_count;
 uint8_t link_mode;
 uint8_t got_test;
 uint8_t got_zx81;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+uint8_t link_flags;
+unsigned int link_threads;
+#endif
 
 const char *empty_str = "";
 const char *specasm_str = "/specasm/";
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Open addressed table of indices into globals[].  Entries hold the index
+ * + 1 so that a zeroed table is empty.  The table has twice as many
+ * entries as globals has room for, so it's never more than half full.
+ * Its size is always a power of 2.
+ */
+
+static uint16_t *global_hash;
+static unsigned int global_hash_size;
+
+static uint32_t prv_hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+#endif
+
 #ifdef SPECASM_TARGET_NEXT
 void specasm_peer_next_copy_chars(void);
 #endif
@@ -70,9 +116,276 @@ const char *salink_get_label_str_e(uint8_t id, uint8_t label_type)
 		return specasm_state_get_short_e(id);
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Grows table so that it can hold at least count entries of size bytes.
+ * The number of entries is doubled each time the table grows.  max holds
+ * the number of entries the table has room for.  NULL is returned if we
+ * run out of memory, in which case table is left as it was.
+ */
+
+static void *prv_grow_e(void *table, unsigned int *max, unsigned int count,
+			size_t size)
+{
+	unsigned int new_max;
+	void *new_table;
+
+	if (count <= *max)
+		return table;
+
+	new_max = *max ? *max : 64;
+	while (new_max < count)
+		new_max *= 2;
+	new_table = realloc(table, new_max * size);
+	if (!new_table) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return NULL;
+	}
+	*max = new_max;
+
+	return new_table;
+}
+
+static void prv_hash_global(unsigned int index)
+{
+	unsigned int slot;
+	unsigned int mask = global_hash_size - 1;
+
+	slot = globals[index].hash & mask;
+	while (global_hash[slot])
+		slot = (slot + 1) & mask;
+	global_hash[slot] = index + 1;
+}
+
+void salink_reserve_labels_e(unsigned int count)
+{
+	salink_label_t *new_labels;
+
+	new_labels = prv_grow_e(labels, &label_max, count, sizeof(*labels));
+	if (new_labels)
+		labels = new_labels;
+}
+
+void salink_reserve_globals_e(unsigned int count)
+{
+	salink_global_t *new_globals;
+	uint16_t *new_hash;
+	unsigned int i;
+
+	new_globals = prv_grow_e(globals, &global_max, count, sizeof(*globals));
+	if (!new_globals)
+		return;
+	globals = new_globals;
+
+	if (global_hash_size >= global_max * 2)
+		return;
+
+	new_hash = calloc(global_max * 2, sizeof(*global_hash));
+	if (!new_hash) {
+		strcpy(error_buf, "Out of memory");
+		err_type = SALINK_ERROR_NO_MEMORY;
+		return;
+	}
+	free(global_hash);
+	global_hash = new_hash;
+	global_hash_size = global_max * 2;
+	for (i = 0; i < global_count; i++)
+		prv_hash_global(i);
+}
+
+void salink_reserve_objs_e(unsigned int count)
+{
+	unsigned int old_max = obj_file_max;
+	salink_obj_t *new_objs;
+
+	new_objs = prv_grow_e(obj_files, &obj_file_max, count,
+			      sizeof(*obj_files));
+	if (!new_objs)
+		return;
+	obj_files = new_objs;
+	memset(&obj_files[old_max], 0,
+	       (obj_file_max - old_max) * sizeof(*obj_files));
+}
+
+void salink_reserve_queued_files_e(unsigned int count)
+{
+	char(*new_fnames)[MAX_FNAME + 1];
+
+	new_fnames = prv_grow_e(queued_fnames, &queued_file_max, count,
+				sizeof(*queued_fnames));
+	if (new_fnames)
+		queued_fnames = new_fnames;
+}
+
+void salink_free_tables(void)
+{
+	free(labels);
+	labels = NULL;
+	label_max = 0;
+	free(globals);
+	globals = NULL;
+	global_max = 0;
+	free(global_hash);
+	global_hash = NULL;
+	global_hash_size = 0;
+	global_count = 0;
+	free(obj_files);
+	obj_files = NULL;
+	obj_file_max = 0;
+	obj_file_count = 0;
+	free(queued_fnames);
+	queued_fnames = NULL;
+	queued_file_max = 0;
+	queued_files = 0;
+}
+
+/*
+ * salink_reserve_globals_e() must have been called to make room for the
+ * new global before its name is filled in.
+ */
+
+void salink_add_global(void)
+{
+	salink_global_t *global = &globals[global_count];
+
+	global->hash = prv_hash_name(global->name);
+	prv_hash_global(global_count);
+}
+
+salink_global_t *salink_find_global(const char *name)
+{
+	salink_global_t *global;
+	unsigned int slot;
+	unsigned int mask = global_hash_size - 1;
+	uint32_t hash;
+
+	salink_stats_count(label_lookups, 1);
+	if (!global_hash_size)
+		return NULL;
+
+	hash = prv_hash_name(name);
+	slot = hash & mask;
+	while (global_hash[slot]) {
+		global = &globals[global_hash[slot] - 1];
+		if ((global->hash == hash) && !strcmp(name, global->name))
+			return global;
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+void salink_reset_globals(void)
+{
+	if (global_hash)
+		memset(global_hash, 0, global_hash_size * sizeof(*global_hash));
+	global_count = 0;
+}
+
+void salink_load_obj_e(salink_obj_t *obj)
+{
+	salink_stats_count(objs_loaded, 1);
+	if (obj->state) {
+		memcpy(&state, obj->state, sizeof(state));
+	} else {
+		salink_lib_load_e(obj->fname);
+		if (err_type == SPECASM_ERROR_OK)
+			salink_stats_count(bytes_read,
+					   salink_stats_state_bytes());
+	}
+}
+
+void salink_free_objs(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < obj_file_count; i++) {
+		free(obj_files[i].state);
+		obj_files[i].state = NULL;
+		salink_free_expressions(&obj_files[i]);
+	}
+}
+#else
+void salink_add_global(void)
+{
+}
+
+salink_global_t *salink_find_global(const char *name)
+{
+	unsigned int i;
+	salink_global_t *global;
+
+	for (i = 0; i < global_count; i++) {
+		global = &globals[i];
+		if (!strcmp(name, global->name))
+			return global;
+	}
+
+	return NULL;
+}
+
+void salink_reset_globals(void)
+{
+	global_count = 0;
+}
+
+void salink_load_obj_e(salink_obj_t *obj)
+{
+	specasm_load_e(obj->fname);
+}
+
+void salink_free_objs(void)
+{
+}
+#endif
+
 int main(int argc, char *argv[])
 {
 	int ret;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	int i;
+	uint8_t print_stats = 0;
+	const char *stats_json = NULL;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--single-pass")) {
+			link_flags |= SALINK_FLAG_SINGLE_PASS;
+		} else if (!strcmp(argv[i], "--drop-unused")) {
+			link_flags |= SALINK_FLAG_DROP_UNUSED;
+		} else if (!strcmp(argv[i], "--relax")) {
+			link_flags |= SALINK_FLAG_RELAX;
+		} else if (!strcmp(argv[i], "--relax-size")) {
+			link_flags |=
+			    SALINK_FLAG_RELAX | SALINK_FLAG_RELAX_SIZE;
+		} else if (!strcmp(argv[i], "--pack-aligns")) {
+			link_flags |= SALINK_FLAG_PACK_ALIGNS;
+		} else if (!strcmp(argv[i], "--deps")) {
+			link_flags |= SALINK_FLAG_DEPS;
+		} else if (!strcmp(argv[i], "--incremental")) {
+			link_flags |= SALINK_FLAG_INCREMENTAL;
+		} else if (!strcmp(argv[i], "--map-full")) {
+			link_flags |= SALINK_FLAG_MAP_FULL;
+		} else if (!strcmp(argv[i], "--stats")) {
+			print_stats = 1;
+		} else if (!strcmp(argv[i], "--stats-json") &&
+			   (i + 1 < argc)) {
+			stats_json = argv[++i];
+		} else if (!strcmp(argv[i], "-j") && (i + 1 < argc) &&
+			   (atoi(argv[i + 1]) > 0)) {
+			link_threads = (unsigned int)atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: salink [--single-pass] "
+					"[--drop-unused] [--relax] "
+					"[--relax-size] [--pack-aligns] "
+					"[--deps] [--incremental] [--map-full] "
+					"[--stats] [--stats-json file] "
+					"[-j threads]\n");
+			return 1;
+		}
+	}
+#endif
 
 #ifdef SPECASM_TARGET_NEXT
 	uint8_t turbo;
@@ -92,7 +405,22 @@ int main(int argc, char *argv[])
 	zx_cls(PAPER_WHITE | INK_BLACK);
 #endif
 
+	salink_stats_start(SALINK_PHASE_TOTAL);
 	ret = salink_link_e();
+	salink_stats_stop(SALINK_PHASE_TOTAL);
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	if (print_stats)
+		salink_stats_print(stdout);
+	if (stats_json) {
+		err_type = SPECASM_ERROR_OK;
+		salink_stats_write_json_e(stats_json);
+		if (err_type != SPECASM_ERROR_OK) {
+			fprintf(stderr, "Failed to write %s\n", stats_json);
+			ret = 1;
+		}
+	}
+#endif
 
 #ifdef SPECASM_TARGET_NEXT
 	ZXN_WRITE_REG(REG_TURBO_MODE, turbo);
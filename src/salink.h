@@ -21,10 +21,29 @@
 
 #include "line.h"
 #include "peer_file.h"
+#include "state_base.h"
+#include "strings.h"
 
+/*
+ * On the Spectrum the tables of object files, globals and labels have a
+ * fixed size.  On the host they're allocated on the heap and grow as
+ * they fill up.  Their sizes are then limited only by the types of the
+ * indices used to refer to their entries.  0xffff is reserved for
+ * SALINK_NO_LABEL.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#define MAX_FILES 0xfffe
+#define MAX_GLOBALS 0xfffe
+#define MAX_LABELS 0xfffe
+typedef uint16_t salink_obj_index_t;
+#else
 #define MAX_FILES 64
 #define MAX_GLOBALS 128
 #define MAX_LABELS 1280
+typedef uint8_t salink_obj_index_t;
+#endif
+#define SALINK_NO_OBJ ((salink_obj_index_t)-1)
 #define MAX_BUFFER_SIZE 1024
 #define MAX_FNAME 42
 
@@ -64,6 +83,8 @@
 #define SALINK_ERROR_DUP_OBJ_FILE (SPECASM_MAX_ERRORS + 19)
 #define SALINK_ERROR_NO_TESTS (SPECASM_MAX_ERRORS + 20)
 #define SALINK_ERROR_X_FILE_TOO_OLD (SPECASM_MAX_ERRORS + 21)
+#define SALINK_ERROR_NO_MEMORY (SPECASM_MAX_ERRORS + 22)
+#define SALINK_ERROR_BAD_LIB (SPECASM_MAX_ERRORS + 23)
 
 /*
  * Label usage for EQU statements
@@ -90,29 +111,120 @@ struct salink_label_t_ {
 typedef struct salink_label_t_ salink_label_t;
 
 struct salink_global_t_ {
-	uint8_t obj_index;
+	salink_obj_index_t obj_index;
 	uint16_t line_no;
 	uint16_t label_index;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	uint32_t hash;
+#endif
 	char name[SPECASM_LINE_MAX_LEN + 1];
 };
 
 typedef struct salink_global_t_ salink_global_t;
 
+/*
+ * On the host each object carries an index that maps the string id of
+ * each of its local labels to the label's position in the labels array.
+ * Entries for ids that do not name a local label are set to
+ * SALINK_NO_LABEL.  The index is built once, when the object is first
+ * parsed, so resolving a jump or a call is a single lookup.  There's
+ * no room for this on the Spectrum where we search the object's labels
+ * instead.
+ *
+ * exps caches the compiled forms of the expressions used by the object's
+ * instructions.  It's allocated when the first expression is compiled.
+ *
+ * addr is the address at which the object starts and end the address at
+ * which the next object starts.  They're set when the object's labels are
+ * made absolute.  The difference between end - addr and size is the
+ * padding added by the object's aligns.
+ */
+
+#define SALINK_NO_LABEL 0xffff
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+struct salink_rpn_t_;
+#endif
+
 struct salink_obj_t_ {
 	char fname[MAX_FNAME + 1];
 	uint16_t label_start;
 	uint16_t label_end;
 	uint16_t size;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	uint16_t short_labels[SPECASM_MAX_SHORT_STRINGS];
+	uint16_t long_labels[SPECASM_MAX_LONG_STRINGS];
+	specasm_state_t *state;
+	struct salink_rpn_t_ **exps;
+	uint16_t addr;
+	uint16_t end;
+	uint8_t excluded;
+#endif
 };
 typedef struct salink_obj_t_ salink_obj_t;
 
+/*
+ * On the host, objects that can't be reached from Main may be excluded
+ * from the link.  See link_reach.h.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#define salink_obj_excluded(obj) ((obj)->excluded)
+#else
+#define salink_obj_excluded(obj) 0
+#endif
+
 extern char scratch[SPECASM_MAX_SCRATCH];
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+extern salink_label_t *labels;
+extern salink_global_t *globals;
+#else
 extern salink_label_t labels[MAX_LABELS];
 extern salink_global_t globals[MAX_GLOBALS];
+#endif
 extern char error_buf[(SPECASM_LINE_MAX_LEN * 4) + 1];
 const char *salink_get_label_str_e(uint8_t id, uint8_t label_type);
 char salink_to_zx81_char(char ch);
 
+/*
+ * The global symbol table.  salink_add_global() must be called once the
+ * name of globals[global_count] has been filled in and before global_count
+ * is incremented.  salink_find_global() returns NULL if no global of the
+ * given name has been added.  On the host globals are hashed.  On the
+ * Spectrum they are searched in order.
+ */
+
+void salink_add_global(void);
+salink_global_t *salink_find_global(const char *name);
+void salink_reset_globals(void);
+
+/*
+ * Object files are read once when they're first parsed and then again
+ * when they're written to the binary and the map file.  On the host,
+ * each object keeps the state it was parsed from so that
+ * salink_load_obj_e() can restore it without going back to the disk.
+ * On the Spectrum there's no room to keep the objects around, so
+ * salink_load_obj_e() reloads the file.
+ */
+
+void salink_load_obj_e(salink_obj_t *obj);
+void salink_free_objs(void);
+
+/*
+ * On the host, the salink_reserve_ functions make sure that there's room
+ * in the corresponding table for at least count entries, growing it if
+ * needed.  Pointers into a table are invalidated when it grows.
+ * salink_free_tables() frees the tables once the link has finished.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+void salink_reserve_labels_e(unsigned int count);
+void salink_reserve_globals_e(unsigned int count);
+void salink_reserve_objs_e(unsigned int count);
+void salink_reserve_queued_files_e(unsigned int count);
+void salink_free_tables(void);
+#endif
+
 extern unsigned int buf_count;
 
 #define MAX_PENDING_X_FILES (MAX_BUFFER_SIZE / (MAX_FNAME + 1))
@@ -132,18 +244,93 @@ typedef union {
 	char fname[MAX_PENDING_X_FILES][MAX_FNAME + 1];
 } salink_buf_t;
 
+/*
+ * The names of the files waiting to be parsed.  On the Spectrum they're
+ * stored in buf.  On the host they have a table of their own.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+extern char (*queued_fnames)[MAX_FNAME + 1];
+#define salink_queued_fname(i) (queued_fnames[i])
+#else
+#define salink_queued_fname(i) (buf.fname[i])
+#endif
+
 #define SALINK_MODE_LINK 0
 #define SALINK_MODE_TEST 1
 #define SALINK_MODE_MAX 2
 
+/*
+ * Options that can be passed to salink on the command line.  These are
+ * only supported on the host.
+ *
+ * SALINK_FLAG_SINGLE_PASS
+ *   Rather than starting from scratch when building the test binary,
+ *   reuse the objects and labels from the main link and add only the
+ *   test objects.
+ *
+ * SALINK_FLAG_DROP_UNUSED
+ *   Leave out the objects that can't be reached from Main.
+ *
+ * SALINK_FLAG_RELAX
+ *   Replace jrs and djnzs that can't reach their targets with jps.
+ *
+ * SALINK_FLAG_RELAX_SIZE
+ *   Also replace unconditional jps with jrs where the target is in range.
+ *   Only used with SALINK_FLAG_RELAX.
+ *
+ * SALINK_FLAG_PACK_ALIGNS
+ *   Reorder the objects that follow Main to reduce the padding added by
+ *   their aligns.
+ *
+ * SALINK_FLAG_DEPS
+ *   Write a make style dependency file, <name>.d, listing the files read
+ *   to build the binary and the test binary.
+ *
+ * SALINK_FLAG_INCREMENTAL
+ *   Save the layout of each binary and copy the bytes of the objects that
+ *   haven't changed from the previous binary.  See link_incr.h.
+ *
+ * SALINK_FLAG_MAP_FULL
+ *   Write a map file, even if none is requested, with the address range
+ *   of each object and the line of each label, along with a sorted binary
+ *   symbol file.  See map.h.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+#define SALINK_FLAG_SINGLE_PASS 1
+#define SALINK_FLAG_DROP_UNUSED 2
+#define SALINK_FLAG_RELAX 4
+#define SALINK_FLAG_RELAX_SIZE 8
+#define SALINK_FLAG_PACK_ALIGNS 16
+#define SALINK_FLAG_DEPS 32
+#define SALINK_FLAG_INCREMENTAL 64
+#define SALINK_FLAG_MAP_FULL 128
+
+extern uint8_t link_flags;
+
+/*
+ * The number of threads used to load object files.  0 means one per
+ * online CPU.
+ */
+
+extern unsigned int link_threads;
+#endif
+
 extern salink_buf_t buf;
 extern char map_name[MAX_FNAME + 1];
 extern unsigned int global_count;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+extern salink_obj_t *obj_files;
+extern unsigned int obj_file_count;
+extern unsigned int queued_files;
+#else
 extern salink_obj_t obj_files[MAX_FILES];
 extern uint8_t obj_file_count;
+extern uint8_t queued_files;
+#endif
 extern char image_name[MAX_FNAME + 1];
 extern unsigned int bin_size;
-extern uint8_t queued_files;
 extern const char *empty_str;
 extern const char *specasm_str;
 extern uint8_t link_mode;
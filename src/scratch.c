@@ -17,4 +17,4 @@
 #include "scratch.h"
 
 
-char scratch[SPECASM_MAX_SCRATCH];
+SPECASM_THREAD_LOCAL char scratch[SPECASM_MAX_SCRATCH];
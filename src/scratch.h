@@ -19,6 +19,6 @@
 
 #include "line.h"
 
-extern char scratch[SPECASM_MAX_SCRATCH];
+extern SPECASM_THREAD_LOCAL char scratch[SPECASM_MAX_SCRATCH];
 
 #endif
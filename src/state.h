@@ -19,7 +19,7 @@
 
 #include "state_base.h"
 
-extern char scratch[SPECASM_MAX_SCRATCH];
+extern SPECASM_THREAD_LOCAL char scratch[SPECASM_MAX_SCRATCH];
 
 uint8_t specasm_state_add_short_e(const char *str);
 uint8_t specasm_state_add_long_e(const char *str);
@@ -37,4 +37,27 @@ void specasm_delete_lines(unsigned int start, unsigned int end);
 void specasm_insert_lines_e(unsigned int l, unsigned int count);
 void specasm_format_line_e(char *buf, unsigned int l);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Parses a line in the same way as specasm_parse_line_e() except that an
+ * expression that doesn't refer to any labels is evaluated straight away
+ * and the line is stored as though its value had been written in place
+ * of the expression.  The line must be valid as written, so exactly the
+ * same lines are accepted as by specasm_parse_line_e().  If the folded
+ * line isn't the immediate form of the same instruction, the line is
+ * stored as it was written.
+ */
+
+void specasm_parse_line_fold_e(unsigned int l, const char *str);
+uint8_t specasm_ctx_state_add_short_e(specasm_ctx_t *ctx, const char *str);
+uint8_t specasm_ctx_state_add_long_e(specasm_ctx_t *ctx, const char *str);
+void specasm_ctx_parse_line_e(specasm_ctx_t *ctx, unsigned int l,
+			      const char *str);
+void specasm_ctx_append_empty_line_e(specasm_ctx_t *ctx);
+void specasm_ctx_format_line_e(specasm_ctx_t *ctx, char *buf, unsigned int l);
+uint8_t specasm_ctx_dump_opcode_e(specasm_ctx_t *ctx,
+				  const specasm_line_t *line, char *buf);
+#endif
+
 #endif
@@ -20,57 +20,162 @@
 #include "peer.h"
 #include "state_base.h"
 
-specasm_state_t state;
-specasm_error_t err_type;
+SPECASM_THREAD_LOCAL specasm_state_t state;
+SPECASM_THREAD_LOCAL specasm_error_t err_type;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+SPECASM_THREAD_LOCAL specasm_state_t *ctx_state;
+SPECASM_THREAD_LOCAL specasm_str_index_t str_index;
+#endif
 
 void specasm_state_reset(void)
 {
-	state.lines.num_lines = 0;
-	state.short_strs.num_strings = 0;
-	state.long_strs.num_strings = 0;
-	state.version = SPECASM_VERSION;
+	cur_state.lines.num_lines = 0;
+	cur_state.short_strs.num_strings = 0;
+	cur_state.long_strs.num_strings = 0;
+	cur_state.version = SPECASM_VERSION;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+	specasm_state_index_strings();
+#endif
 }
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+static uint8_t prv_str_hash(const char *str)
+{
+	uint16_t hash = 5381;
+
+	while (*str)
+		hash = hash * 33 + (uint8_t)*str++;
+
+	return (uint8_t)(hash ^ (hash >> 8));
+}
+
+/*
+ * The tables have twice as many slots as there are strings so there's
+ * always an empty slot to stop the probe.
+ */
+
+static uint8_t *prv_find_slot(uint8_t *slots, uint8_t mask, const char *strs,
+			      uint8_t len, const char *str)
+{
+	uint8_t i = prv_str_hash(str) & mask;
+
+	while (slots[i] && strcmp(&strs[(slots[i] - 1) * len], str))
+		i = (i + 1) & mask;
+
+	return &slots[i];
+}
+
+/*
+ * If a state contains the same string twice, the first one wins, just as
+ * it would with a linear search.
+ */
+
+static void prv_index_strs(uint8_t *slots, uint8_t mask, const char *strs,
+			   uint8_t len, uint8_t count)
+{
+	uint8_t i;
+	uint8_t *slot;
+
+	memset(slots, 0, mask + 1);
+	for (i = 0; i < count; i++) {
+		slot = prv_find_slot(slots, mask, strs, len, &strs[i * len]);
+		if (!*slot)
+			*slot = i + 1;
+	}
+}
+
+/*
+ * The counts of a corrupt state may be out of range.  Only the strings
+ * that fit in the tables are indexed so that the probes always end.
+ */
+
+void specasm_state_index_strings(void)
+{
+	uint8_t num_short = cur_state.short_strs.num_strings;
+	uint8_t num_long = cur_state.long_strs.num_strings;
+
+	str_index.owner = &cur_state;
+	str_index.num_short = num_short;
+	str_index.num_long = num_long;
+	if (num_short > SPECASM_MAX_SHORT_STRINGS)
+		num_short = SPECASM_MAX_SHORT_STRINGS;
+	if (num_long > SPECASM_MAX_LONG_STRINGS)
+		num_long = SPECASM_MAX_LONG_STRINGS;
+	prv_index_strs(str_index.short_slots, SPECASM_SHORT_INDEX_SLOTS - 1,
+		       cur_state.short_strs.strs, SPECASM_MAX_SHORT_LEN,
+		       num_short);
+	prv_index_strs(str_index.long_slots, SPECASM_LONG_INDEX_SLOTS - 1,
+		       cur_state.long_strs.strs, SPECASM_MAX_LONG_LEN, num_long);
+}
+
+static void prv_check_index(void)
+{
+	if ((str_index.owner != &cur_state) ||
+	    (str_index.num_short != cur_state.short_strs.num_strings) ||
+	    (str_index.num_long != cur_state.long_strs.num_strings))
+		specasm_state_index_strings();
+}
+
+uint8_t *specasm_state_short_slot(const char *str)
+{
+	prv_check_index();
+	return prv_find_slot(str_index.short_slots,
+			     SPECASM_SHORT_INDEX_SLOTS - 1,
+			     cur_state.short_strs.strs, SPECASM_MAX_SHORT_LEN,
+			     str);
+}
+
+uint8_t *specasm_state_long_slot(const char *str)
+{
+	prv_check_index();
+	return prv_find_slot(str_index.long_slots,
+			     SPECASM_LONG_INDEX_SLOTS - 1,
+			     cur_state.long_strs.strs, SPECASM_MAX_LONG_LEN, str);
+}
+#endif
+
 const char *specasm_state_get_short_e(uint8_t i)
 {
 	uint16_t off;
 
-	if (i >= state.short_strs.num_strings) {
+	if (i >= cur_state.short_strs.num_strings) {
 		err_type = SPECASM_ERROR_ASSERT_BAD_STRING_ID;
 		return NULL;
 	}
 
 	off = i;
 	off = specasm_short_string_offset(off);
-	return &state.short_strs.strs[off];
+	return &cur_state.short_strs.strs[off];
 }
 
 const char *specasm_state_get_long_e(uint8_t i)
 {
 	uint16_t off;
 
-	if (i >= state.long_strs.num_strings) {
+	if (i >= cur_state.long_strs.num_strings) {
 		err_type = SPECASM_ERROR_ASSERT_BAD_STRING_ID;
 		return NULL;
 	}
 
 	off = i;
 	off = specasm_short_long_offset(off);
-	return &state.long_strs.strs[off];
+	return &cur_state.long_strs.strs[off];
 }
 
 /*
  * Code for the fletcher16 algorithm copied from
  * https://en.wikipedia.org/wiki/Fletcher%27s_checksum#cite_note-3
- * Modified to take a uint16_t as the length.  We also use
- * modulo 256 instead of 255.  It makes the checksum worse but
+ * Modified to take a uint16_t as the length and to continue from a
+ * previous checksum, so that a file can be checksummed in pieces.  We
+ * also use modulo 256 instead of 255.  It makes the checksum worse but
  * module 255 is too slow.
  */
 
-static uint16_t prv_fletcher16(const uint8_t *data, uint16_t len)
+static uint16_t prv_fletcher16(uint16_t sum, const uint8_t *data,
+			       uint16_t len)
 {
-	uint16_t sum1 = 0;
-	uint16_t sum2 = 0;
+	uint16_t sum1 = sum & 255;
+	uint16_t sum2 = sum >> 8;
 	const uint8_t *end_data = data + len;
 
 	while (data != end_data) {
@@ -81,33 +186,92 @@ static uint16_t prv_fletcher16(const uint8_t *data, uint16_t len)
 	return (sum2 << 8) | sum1;
 }
 
-void specasm_save_e(const char *fname)
+static const uint8_t obj_magic[SPECASM_OBJ_MAGIC_LEN] = {0xff, 'S', 'A',
+							 'X'};
+
+/*
+ * Set by specasm_obj_header_apply_e() so that specasm_load_e() knows
+ * which parts of the state the checksum covers.
+ */
+
+static SPECASM_THREAD_LOCAL uint8_t obj_old_format;
+
+void specasm_obj_header_init(specasm_obj_header_t *hdr)
 {
-	uint16_t checksum;
+	memcpy(hdr->magic, obj_magic, SPECASM_OBJ_MAGIC_LEN);
+	hdr->version = cur_state.version;
+	hdr->num_lines = cur_state.lines.num_lines;
+	hdr->num_short = cur_state.short_strs.num_strings;
+	hdr->num_long = cur_state.long_strs.num_strings;
+}
+
+uint8_t specasm_obj_header_apply_e(const specasm_obj_header_t *hdr)
+{
+	obj_old_format = memcmp(hdr->magic, obj_magic,
+				SPECASM_OBJ_MAGIC_LEN) != 0;
+	if (obj_old_format)
+		return 0;
+
+	if ((hdr->num_lines > SPECASM_MAX_LINES) ||
+	    (hdr->num_short > SPECASM_MAX_SHORT_STRINGS) ||
+	    (hdr->num_long > SPECASM_MAX_LONG_STRINGS)) {
+		err_type = SPECASM_ERROR_CORRUPT;
+		return 1;
+	}
 
-	checksum = prv_fletcher16((const uint8_t *)&state, sizeof(state));
+	cur_state.version = hdr->version;
+	cur_state.lines.num_lines = hdr->num_lines;
+	cur_state.short_strs.num_strings = hdr->num_short;
+	cur_state.long_strs.num_strings = hdr->num_long;
 
-	specasm_peer_write_state_e(fname, checksum);
+	return 1;
 }
 
-void specasm_load_e(const char *fname)
+/*
+ * The checksum covers the header and the lines and strings in use, in
+ * the order in which they're stored in the file.
+ */
+
+static uint16_t prv_obj_checksum(void)
+{
+	specasm_obj_header_t hdr;
+	uint16_t sum;
+
+	specasm_obj_header_init(&hdr);
+	sum = prv_fletcher16(0, (const uint8_t *)&hdr, sizeof(hdr));
+	sum = prv_fletcher16(sum, (const uint8_t *)cur_state.lines.lines,
+			     hdr.num_lines * sizeof(specasm_line_t));
+	sum = prv_fletcher16(sum, (const uint8_t *)cur_state.short_strs.strs,
+			     hdr.num_short * SPECASM_MAX_SHORT_LEN);
+	return prv_fletcher16(sum, (const uint8_t *)cur_state.long_strs.strs,
+			      hdr.num_long * SPECASM_MAX_LONG_LEN);
+}
+
+void specasm_save_e(const char *fname)
+{
+	specasm_peer_write_state_e(fname, prv_obj_checksum());
+}
+
+static void prv_check_loaded_e(uint16_t old_checksum)
 {
 	uint16_t checksum;
-	uint16_t old_checksum;
 
-	old_checksum = specasm_peer_read_state_e(fname);
 	if (err_type == SPECASM_ERROR_OPEN)
 		return;
 
 	if (err_type != SPECASM_ERROR_OK)
 		goto on_error;
 
-	if (state.lines.num_lines > SPECASM_MAX_LINES) {
+	if (cur_state.lines.num_lines > SPECASM_MAX_LINES) {
 		err_type = SPECASM_ERROR_CORRUPT;
 		goto on_error;
 	}
 
-	checksum = prv_fletcher16((const uint8_t *)&state, sizeof(state));
+	if (obj_old_format)
+		checksum = prv_fletcher16(0, (const uint8_t *)&cur_state,
+					  sizeof(state));
+	else
+		checksum = prv_obj_checksum();
 	if (checksum != old_checksum) {
 		err_type = SPECASM_ERROR_CORRUPT;
 		return;
@@ -118,9 +282,12 @@ void specasm_load_e(const char *fname)
 	 * of the file format.
 	 */
 
-	if (((SPECASM_VERSION & 0x8000) == (state.version & 0x8000)) &&
-	    (SPECASM_VERSION >= state.version)) {
-		state.version = SPECASM_VERSION;
+	if (((SPECASM_VERSION & 0x8000) == (cur_state.version & 0x8000)) &&
+	    (SPECASM_VERSION >= cur_state.version)) {
+		cur_state.version = SPECASM_VERSION;
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+		specasm_state_index_strings();
+#endif
 		return;
 	}
 
@@ -130,6 +297,18 @@ on_error:
 	specasm_state_reset();
 }
 
+void specasm_load_e(const char *fname)
+{
+	prv_check_loaded_e(specasm_peer_read_state_e(fname));
+}
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+void specasm_load_at_e(const char *fname, uint32_t offset)
+{
+	prv_check_loaded_e(specasm_peer_read_state_at_e(fname, offset));
+}
+#endif
+
 uint16_t specasm_compute_line_size(specasm_line_t *line)
 {
 	uint16_t id;
@@ -164,3 +343,48 @@ uint16_t specasm_compute_line_size(specasm_line_t *line)
 
 	return 0;
 }
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+void specasm_ctx_enter(specasm_ctx_t *ctx, specasm_ctx_save_t *save)
+{
+	save->state = ctx_state;
+	save->err_type = err_type;
+	ctx_state = &ctx->state;
+	err_type = ctx->err_type;
+}
+
+void specasm_ctx_leave(specasm_ctx_t *ctx, const specasm_ctx_save_t *save)
+{
+	ctx->err_type = err_type;
+	err_type = save->err_type;
+	ctx_state = save->state;
+}
+
+void specasm_ctx_init(specasm_ctx_t *ctx)
+{
+	specasm_ctx_save_t save;
+
+	ctx->err_type = SPECASM_ERROR_OK;
+	specasm_ctx_enter(ctx, &save);
+	specasm_state_reset();
+	specasm_ctx_leave(ctx, &save);
+}
+
+void specasm_ctx_load_e(specasm_ctx_t *ctx, const char *fname)
+{
+	specasm_ctx_save_t save;
+
+	specasm_ctx_enter(ctx, &save);
+	specasm_load_e(fname);
+	specasm_ctx_leave(ctx, &save);
+}
+
+void specasm_ctx_save_e(specasm_ctx_t *ctx, const char *fname)
+{
+	specasm_ctx_save_t save;
+
+	specasm_ctx_enter(ctx, &save);
+	specasm_save_e(fname);
+	specasm_ctx_leave(ctx, &save);
+}
+#endif
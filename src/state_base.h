@@ -18,11 +18,11 @@
 #define SPECASM_STATE_READ_H
 
 #ifdef SPECASM_TARGET_NEXT_OPCODES
-#define SPECASM_VERSION 0x800b
-#define SPECASM_VERSION_STR "v11n"
+#define SPECASM_VERSION 0x800c
+#define SPECASM_VERSION_STR "v12n"
 #else
-#define SPECASM_VERSION 11
-#define SPECASM_VERSION_STR "v11"
+#define SPECASM_VERSION 12
+#define SPECASM_VERSION_STR "v12"
 #endif
 
 #include <stdint.h>
@@ -38,7 +38,21 @@ struct specasm_state_t_ {
 };
 typedef struct specasm_state_t_ specasm_state_t;
 
-extern specasm_state_t state;
+extern SPECASM_THREAD_LOCAL specasm_state_t state;
+
+/*
+ * The functions that work on a file refer to it as cur_state.  On the
+ * Spectrum this is always the global state.  On the host it's the state
+ * of the context passed to one of the specasm_ctx_ functions, or the
+ * global state if no context is active.
+ */
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+extern SPECASM_THREAD_LOCAL specasm_state_t *ctx_state;
+#define cur_state (*(ctx_state ? ctx_state : &state))
+#else
+#define cur_state state
+#endif
 
 void specasm_state_reset(void);
 
@@ -48,6 +62,109 @@ const char *specasm_state_get_long_e(uint8_t i);
 void specasm_load_e(const char *fname);
 void specasm_save_e(const char *fname);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+/*
+ * Host only.  An open addressed hash index over the strings of cur_state
+ * that saves specasm_state_add_short_e() and specasm_state_add_long_e()
+ * from comparing a new string with every string already in the state.
+ * Each slot holds the index of a string plus one, or 0 if it's empty.
+ * The index isn't part of the state and is never saved.  It's rebuilt by
+ * specasm_state_index_strings(), which is called when a state is reset
+ * or loaded, and is rebuilt automatically if cur_state changes or its
+ * string counts no longer match those of the index.
+ *
+ * specasm_state_short_slot() and specasm_state_long_slot() return either
+ * the slot holding str or the empty slot in which it belongs.  A caller
+ * that adds str to the state must fill in the slot and increment the
+ * index's count.
+ */
+
+#define SPECASM_SHORT_INDEX_SLOTS (SPECASM_MAX_SHORT_STRINGS * 2)
+#define SPECASM_LONG_INDEX_SLOTS (SPECASM_MAX_LONG_STRINGS * 2)
+
+struct specasm_str_index_t_ {
+	const specasm_state_t *owner;
+	uint8_t num_short;
+	uint8_t num_long;
+	uint8_t short_slots[SPECASM_SHORT_INDEX_SLOTS];
+	uint8_t long_slots[SPECASM_LONG_INDEX_SLOTS];
+};
+typedef struct specasm_str_index_t_ specasm_str_index_t;
+
+extern SPECASM_THREAD_LOCAL specasm_str_index_t str_index;
+
+void specasm_state_index_strings(void);
+uint8_t *specasm_state_short_slot(const char *str);
+uint8_t *specasm_state_long_slot(const char *str);
+#endif
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+/*
+ * Host only.  Loads a file stored offset bytes into fname.
+ */
+
+void specasm_load_at_e(const char *fname, uint32_t offset);
+#endif
+
+/*
+ * Object files begin with a header, which is followed by the lines, the
+ * short strings and the long strings in use, and a checksum.  Files
+ * written by older versions of Specasm have no header and contain an
+ * image of the whole of specasm_state_t.  The peers read the first
+ * sizeof(specasm_obj_header_t) bytes of a file and pass them to
+ * specasm_obj_header_apply_e(), which returns 0 if the file is in the
+ * old format.  In this case the bytes belong at the start of the state
+ * and the remainder of the image follows.
+ */
+
+#define SPECASM_OBJ_MAGIC_LEN 4
+
+struct specasm_obj_header_t_ {
+	uint8_t magic[SPECASM_OBJ_MAGIC_LEN];
+	uint16_t version;
+	uint16_t num_lines;
+	uint8_t num_short;
+	uint8_t num_long;
+};
+typedef struct specasm_obj_header_t_ specasm_obj_header_t;
+
+void specasm_obj_header_init(specasm_obj_header_t *hdr);
+uint8_t specasm_obj_header_apply_e(const specasm_obj_header_t *hdr);
+
 uint16_t specasm_compute_line_size(specasm_line_t *line);
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+
+/*
+ * Host only.  A context holds a file and its error state, allowing a
+ * program to work on several files at once, from one or more threads.
+ * Each specasm_ctx_ function behaves like the function of the same name
+ * without the ctx_, except that it works on ctx->state and sets
+ * ctx->err_type rather than err_type.  A context may only be used by one
+ * thread at a time.
+ *
+ * specasm_ctx_enter() and specasm_ctx_leave() can be used to call the
+ * other functions in this library on a context.
+ */
+
+struct specasm_ctx_t_ {
+	specasm_state_t state;
+	specasm_error_t err_type;
+};
+typedef struct specasm_ctx_t_ specasm_ctx_t;
+
+struct specasm_ctx_save_t_ {
+	specasm_state_t *state;
+	specasm_error_t err_type;
+};
+typedef struct specasm_ctx_save_t_ specasm_ctx_save_t;
+
+void specasm_ctx_enter(specasm_ctx_t *ctx, specasm_ctx_save_t *save);
+void specasm_ctx_leave(specasm_ctx_t *ctx, const specasm_ctx_save_t *save);
+
+void specasm_ctx_init(specasm_ctx_t *ctx);
+void specasm_ctx_load_e(specasm_ctx_t *ctx, const char *fname);
+void specasm_ctx_save_e(specasm_ctx_t *ctx, const char *fname);
+#endif
+
 #endif
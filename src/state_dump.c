@@ -76,7 +76,7 @@ void specasm_format_line_e(char *buf, unsigned int l)
 	char *start;
 	uint8_t i;
 	const char str_ids[] = {'\'', '"', '#', '@', '-', '+', '!'};
-	const specasm_line_t *line = &state.lines.lines[l];
+	const specasm_line_t *line = &cur_state.lines.lines[l];
 	uint8_t type = specasm_line_get_adj_type(line);
 
 	end_ptr = buf + SPECASM_LINE_MAX_LEN;
@@ -142,3 +142,27 @@ clear:
 		*buf++ = ' ';
 	*buf = 0;
 }
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+void specasm_ctx_format_line_e(specasm_ctx_t *ctx, char *buf, unsigned int l)
+{
+	specasm_ctx_save_t save;
+
+	specasm_ctx_enter(ctx, &save);
+	specasm_format_line_e(buf, l);
+	specasm_ctx_leave(ctx, &save);
+}
+
+uint8_t specasm_ctx_dump_opcode_e(specasm_ctx_t *ctx,
+				  const specasm_line_t *line, char *buf)
+{
+	specasm_ctx_save_t save;
+	uint8_t len;
+
+	specasm_ctx_enter(ctx, &save);
+	len = specasm_dump_opcode_e(line, buf);
+	specasm_ctx_leave(ctx, &save);
+
+	return len;
+}
+#endif
@@ -19,11 +19,56 @@
 #include "scratch.h"
 #include "state.h"
 
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+uint8_t specasm_state_add_short_e(const char *str)
+{
+	uint8_t *slot = specasm_state_short_slot(str);
+	uint8_t max_strs = cur_state.short_strs.num_strings;
+
+	if (*slot)
+		return *slot - 1;
+
+	if (max_strs >= SPECASM_MAX_SHORT_STRINGS) {
+		err_type = SPECASM_ERROR_TOO_MANY_SHORT_STRINGS;
+		return 0xff;
+	}
+
+	strcpy(&cur_state.short_strs.strs[max_strs * SPECASM_MAX_SHORT_LEN],
+	       str);
+	*slot = max_strs + 1;
+	cur_state.short_strs.num_strings++;
+	str_index.num_short++;
+
+	return max_strs;
+}
+
+uint8_t specasm_state_add_long_e(const char *str)
+{
+	uint8_t *slot = specasm_state_long_slot(str);
+	uint8_t max_strs = cur_state.long_strs.num_strings;
+
+	if (*slot)
+		return *slot - 1;
+
+	if (max_strs >= SPECASM_MAX_LONG_STRINGS) {
+		err_type = SPECASM_ERROR_TOO_MANY_LONG_STRINGS;
+		return 0xff;
+	}
+
+	strcpy(&cur_state.long_strs.strs[max_strs * SPECASM_MAX_LONG_LEN],
+	       str);
+	*slot = max_strs + 1;
+	cur_state.long_strs.num_strings++;
+	str_index.num_long++;
+
+	return max_strs;
+}
+#else
 uint8_t specasm_state_add_short_e(const char *str)
 {
 	uint8_t i;
-	uint8_t max_strs = state.short_strs.num_strings;
-	char *ptr = state.short_strs.strs;
+	uint8_t max_strs = cur_state.short_strs.num_strings;
+	char *ptr = cur_state.short_strs.strs;
 
 	for (i = 0; i < max_strs && strcmp(ptr, str); i++)
 		ptr += SPECASM_MAX_SHORT_LEN;
@@ -37,7 +82,7 @@ uint8_t specasm_state_add_short_e(const char *str)
 	}
 
 	strcpy(ptr, str);
-	state.short_strs.num_strings++;
+	cur_state.short_strs.num_strings++;
 
 	return max_strs;
 }
@@ -45,8 +90,8 @@ uint8_t specasm_state_add_short_e(const char *str)
 uint8_t specasm_state_add_long_e(const char *str)
 {
 	uint8_t i;
-	uint8_t max_strs = state.long_strs.num_strings;
-	char *ptr = state.long_strs.strs;
+	uint8_t max_strs = cur_state.long_strs.num_strings;
+	char *ptr = cur_state.long_strs.strs;
 
 	for (i = 0; i < max_strs && strcmp(ptr, str); i++)
 		ptr += SPECASM_MAX_LONG_LEN;
@@ -60,10 +105,11 @@ uint8_t specasm_state_add_long_e(const char *str)
 	}
 
 	strcpy(ptr, str);
-	state.long_strs.num_strings++;
+	cur_state.long_strs.num_strings++;
 
 	return max_strs;
 }
+#endif
 
 static uint8_t prv_is_reg(const char *str)
 {
@@ -310,7 +356,7 @@ static uint8_t prv_parse_include_e(const char *str, char type, uint8_t i,
 void specasm_set_comment(unsigned int l, const char *str)
 {
 	uint8_t i;
-	specasm_line_t *line = &state.lines.lines[l];
+	specasm_line_t *line = &cur_state.lines.lines[l];
 
 	line->comment = SPECASM_NULL;
 
@@ -340,12 +386,12 @@ void specasm_append_empty_line_e(void)
 {
 	specasm_line_t *line;
 
-	if (state.lines.num_lines == SPECASM_MAX_LINES - 1) {
+	if (cur_state.lines.num_lines == SPECASM_MAX_LINES - 1) {
 		err_type = SPECASM_ERROR_TOO_MANY_LINES;
 		return;
 	}
 
-	line = &state.lines.lines[state.lines.num_lines++];
+	line = &cur_state.lines.lines[cur_state.lines.num_lines++];
 	line->type = SPECASM_LINE_TYPE_EMPTY;
 }
 
@@ -355,12 +401,12 @@ void specasm_delete_lines_banked(unsigned int start, unsigned int end)
 void specasm_delete_lines(unsigned int start, unsigned int end)
 #endif
 {
-	if ((start >= end) || (end > state.lines.num_lines))
+	if ((start >= end) || (end > cur_state.lines.num_lines))
 		return;
 
-	for (; end < state.lines.num_lines; end++, start++)
-		state.lines.lines[start] = state.lines.lines[end];
-	state.lines.num_lines -= (end - start);
+	for (; end < cur_state.lines.num_lines; end++, start++)
+		cur_state.lines.lines[start] = cur_state.lines.lines[end];
+	cur_state.lines.num_lines -= (end - start);
 }
 
 #if defined(SPECASM_NEXT_BANKED) || defined(SPECASM_128_BANKED)
@@ -374,29 +420,30 @@ void specasm_insert_lines_e(unsigned int l, unsigned int count)
 	unsigned int old_last_line;
 	unsigned int old_start_line;
 
-	if (state.lines.num_lines + count >= SPECASM_MAX_LINES) {
+	if (cur_state.lines.num_lines + count >= SPECASM_MAX_LINES) {
 		err_type = SPECASM_ERROR_TOO_MANY_LINES;
 		return;
 	}
 
-	if (l >= state.lines.num_lines) {
+	if (l >= cur_state.lines.num_lines) {
 		for (i = 0; i < count; i++)
 			specasm_append_empty_line_e();
 		return;
 	}
 
-	old_last_line = state.lines.num_lines - 1;
+	old_last_line = cur_state.lines.num_lines - 1;
 	old_start_line = l + count;
 
 	for (i = old_last_line + count; i >= old_start_line; i--)
-		state.lines.lines[i] = state.lines.lines[old_last_line--];
+		cur_state.lines.lines[i] =
+		    cur_state.lines.lines[old_last_line--];
 
 	for (; l < old_start_line; l++) {
-		line = &state.lines.lines[i];
+		line = &cur_state.lines.lines[i];
 		line->type = SPECASM_LINE_TYPE_EMPTY;
 	}
 
-	state.lines.num_lines += count;
+	cur_state.lines.num_lines += count;
 }
 
 #if defined(SPECASM_NEXT_BANKED) || defined(SPECASM_128_BANKED)
@@ -406,7 +453,7 @@ void specasm_parse_line_e(unsigned int l, const char *str)
 #endif
 {
 	uint8_t i;
-	specasm_line_t *line = &state.lines.lines[l];
+	specasm_line_t *line = &cur_state.lines.lines[l];
 
 	line->type = SPECASM_LINE_TYPE_EMPTY;
 	line->comment = SPECASM_NULL;
@@ -454,3 +501,82 @@ void specasm_parse_line_e(unsigned int l, const char *str)
 
 	prv_parse_short_comment_e(str, i + 1, line);
 }
+
+#if !defined(SPECTRUM) && !defined(__ZXNEXT)
+/*
+ * The line is always parsed as written first, so that only lines the
+ * Spectrum tools accept are folded.  The folded line differs only in
+ * the expression, so if it has the immediate type of the same
+ * instruction it's the immediate form of the same operand.  Any strings
+ * added by the first parse, e.g., the expression, are dropped before
+ * the folded line is parsed.
+ */
+
+void specasm_parse_line_fold_e(unsigned int l, const char *str)
+{
+	char folded[SPECASM_LINE_MAX_LEN + 1];
+	specasm_line_t *line = &cur_state.lines.lines[l];
+	uint8_t num_short = cur_state.short_strs.num_strings;
+	uint8_t num_long = cur_state.long_strs.num_strings;
+	uint8_t type;
+
+	specasm_parse_line_e(l, str);
+	if ((err_type != SPECASM_ERROR_OK) ||
+	    (line->type < SPECASM_LINE_TYPE_EXP_ADJ) ||
+	    !specasm_fold_exp(str, folded))
+		return;
+
+	type = line->type - SPECASM_LINE_TYPE_EXP_ADJ;
+	cur_state.short_strs.num_strings = num_short;
+	cur_state.long_strs.num_strings = num_long;
+	specasm_parse_line_e(l, folded);
+	if ((err_type == SPECASM_ERROR_OK) && (line->type == type))
+		return;
+
+	err_type = SPECASM_ERROR_OK;
+	specasm_parse_line_e(l, str);
+}
+
+uint8_t specasm_ctx_state_add_short_e(specasm_ctx_t *ctx, const char *str)
+{
+	specasm_ctx_save_t save;
+	uint8_t id;
+
+	specasm_ctx_enter(ctx, &save);
+	id = specasm_state_add_short_e(str);
+	specasm_ctx_leave(ctx, &save);
+
+	return id;
+}
+
+uint8_t specasm_ctx_state_add_long_e(specasm_ctx_t *ctx, const char *str)
+{
+	specasm_ctx_save_t save;
+	uint8_t id;
+
+	specasm_ctx_enter(ctx, &save);
+	id = specasm_state_add_long_e(str);
+	specasm_ctx_leave(ctx, &save);
+
+	return id;
+}
+
+void specasm_ctx_parse_line_e(specasm_ctx_t *ctx, unsigned int l,
+			      const char *str)
+{
+	specasm_ctx_save_t save;
+
+	specasm_ctx_enter(ctx, &save);
+	specasm_parse_line_e(l, str);
+	specasm_ctx_leave(ctx, &save);
+}
+
+void specasm_ctx_append_empty_line_e(specasm_ctx_t *ctx)
+{
+	specasm_ctx_save_t save;
+
+	specasm_ctx_enter(ctx, &save);
+	specasm_append_empty_line_e();
+	specasm_ctx_leave(ctx, &save);
+}
+#endif
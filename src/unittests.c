@@ -21,6 +21,7 @@
 #include "editor_tests.h"
 #include "error.h"
 #include "line.h"
+#include "line_common.h"
 #include "state.h"
 #include "test_content.h"
 
@@ -307,6 +308,83 @@ static int prv_test_bad_opcodes()
 	return 0;
 }
 
+/*
+ * Checks that the perfect hash of the mnemomics finds every mnemomic,
+ * and only the mnemomics.
+ */
+
+/*
+ * Every mnemomic in the table, for the 48k or the Next, whichever we're
+ * built for, must be found by the hash, and each must occupy exactly one
+ * slot.  The Next only mnemomics must only be found on the Next.
+ */
+
+static int prv_test_mnemomics()
+{
+	uint8_t i;
+	uint8_t found;
+	uint8_t used = 0;
+	static const char *const not_mnemomics[] = {
+	    "", "a", "lx", "ldirr", "cpx", "nextreg2", "zx80",
+	};
+	static const char *const next_mnemomics[] = {
+	    "brlc", "lddrx", "ldpirx", "mirror", "nextreg", "swapnib", "test",
+	};
+
+	printf("mnemomic hash: ");
+	for (i = 0; i < SPECASM_MNEMOMIC_SLOTS; i++) {
+		if (!mnemomics_hash[i])
+			continue;
+		if (mnemomics_hash[i] > mnemomics_table_size) {
+			printf("[FAIL]\n\t>bad slot %d\n", i);
+			return 1;
+		}
+		used++;
+	}
+	if (used != mnemomics_table_size) {
+		printf("[FAIL]\n\t>%d slots used for %d mnemomics\n", used,
+		       mnemomics_table_size);
+		return 1;
+	}
+
+	for (i = 0; i < mnemomics_table_size; i++) {
+		found = specasm_find_mnemomic(mnemomics_table[i].mnemomic);
+		if (found != i) {
+			printf("[FAIL]\n\t>%s found at %d expected %d\n",
+			       mnemomics_table[i].mnemomic, found, i);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < sizeof(not_mnemomics) / sizeof(not_mnemomics[0]);
+	     i++) {
+		if (specasm_find_mnemomic(not_mnemomics[i]) !=
+		    SPECASM_MNEMOMIC_NONE) {
+			printf("[FAIL]\n\t>%s found\n", not_mnemomics[i]);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < sizeof(next_mnemomics) / sizeof(next_mnemomics[0]);
+	     i++) {
+		found = specasm_find_mnemomic(next_mnemomics[i]);
+#ifdef SPECASM_TARGET_NEXT_OPCODES
+		if (found == SPECASM_MNEMOMIC_NONE) {
+			printf("[FAIL]\n\t>%s not found\n", next_mnemomics[i]);
+			return 1;
+		}
+#else
+		if (found != SPECASM_MNEMOMIC_NONE) {
+			printf("[FAIL]\n\t>%s found\n", next_mnemomics[i]);
+			return 1;
+		}
+#endif
+	}
+
+	printf("[OK]\n");
+	return 0;
+}
+
 static int prv_test_old_version()
 {
 	err_type = SPECASM_ERROR_OK;
@@ -326,6 +404,223 @@ static int prv_test_old_version()
 	return 0;
 }
 
+/*
+ * Saves a file containing all the format tests and checks that the lines
+ * and strings in use survive a round trip, whatever the state held
+ * before it was loaded.
+ */
+
+static int prv_test_save_load()
+{
+	size_t i;
+	char buf[SPECASM_MAX_SCRATCH];
+	static specasm_state_t saved;
+
+	printf("save_load: ");
+	err_type = SPECASM_ERROR_OK;
+	specasm_state_reset();
+
+	for (i = 0; i < format_tests_count; i++) {
+		specasm_append_empty_line_e();
+		memset(buf, ' ', SPECASM_LINE_MAX_LEN);
+		buf[SPECASM_LINE_MAX_LEN] = 0;
+		memcpy(buf, format_tests[i].source,
+		       strlen(format_tests[i].source));
+		specasm_parse_line_e(i, buf);
+		if (err_type != SPECASM_ERROR_OK) {
+			printf("[FAIL]\n\t>%s: %s\n", format_tests[i].source,
+			       error_msgs[err_type]);
+			return 1;
+		}
+	}
+
+	specasm_save_e("hello");
+	if (err_type != SPECASM_ERROR_OK) {
+		printf("[FAIL]\n\t>save: %s\n", error_msgs[err_type]);
+		return 1;
+	}
+	memcpy(&saved, &state, sizeof(state));
+	memset(&state, 0xaa, sizeof(state));
+
+	specasm_load_e("hello");
+	if (err_type != SPECASM_ERROR_OK) {
+		printf("[FAIL]\n\t>load: %s\n", error_msgs[err_type]);
+		return 1;
+	}
+
+	if ((state.lines.num_lines != saved.lines.num_lines) ||
+	    (state.short_strs.num_strings != saved.short_strs.num_strings) ||
+	    (state.long_strs.num_strings != saved.long_strs.num_strings) ||
+	    memcmp(state.lines.lines, saved.lines.lines,
+		   saved.lines.num_lines * sizeof(specasm_line_t)) ||
+	    memcmp(state.short_strs.strs, saved.short_strs.strs,
+		   saved.short_strs.num_strings * SPECASM_MAX_SHORT_LEN) ||
+	    memcmp(state.long_strs.strs, saved.long_strs.strs,
+		   saved.long_strs.num_strings * SPECASM_MAX_LONG_LEN)) {
+		printf("[FAIL]\n\t>loaded state differs\n");
+		return 1;
+	}
+
+	specasm_state_reset();
+	printf("[OK]\n");
+	return 0;
+}
+
+/*
+ * Fills both string tables, checking that each string can be found
+ * again, both before and after the state has been saved and reloaded.
+ */
+
+static int prv_check_strings(const char *when)
+{
+	unsigned int i;
+	char buf[SPECASM_MAX_LONG_LEN];
+
+	for (i = 0; i < SPECASM_MAX_SHORT_STRINGS; i++) {
+		snprintf(buf, sizeof(buf), "s%u", i * 7);
+		if (specasm_state_add_short_e(buf) != i) {
+			printf("[FAIL]\n\t>%s: short %s not found\n", when,
+			       buf);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < SPECASM_MAX_LONG_STRINGS; i++) {
+		snprintf(buf, sizeof(buf), "a long string %u", i * 13);
+		if (specasm_state_add_long_e(buf) != i) {
+			printf("[FAIL]\n\t>%s: long %s not found\n", when,
+			       buf);
+			return 1;
+		}
+	}
+
+	if ((err_type != SPECASM_ERROR_OK) ||
+	    (state.short_strs.num_strings != SPECASM_MAX_SHORT_STRINGS) ||
+	    (state.long_strs.num_strings != SPECASM_MAX_LONG_STRINGS)) {
+		printf("[FAIL]\n\t>%s: strings added\n", when);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int prv_test_strings()
+{
+	printf("strings: ");
+	err_type = SPECASM_ERROR_OK;
+	specasm_state_reset();
+
+	if (prv_check_strings("add") || prv_check_strings("find"))
+		return 1;
+
+	(void)specasm_state_add_short_e("new");
+	if (err_type != SPECASM_ERROR_TOO_MANY_SHORT_STRINGS) {
+		printf("[FAIL]\n\t>short table not full\n");
+		return 1;
+	}
+	err_type = SPECASM_ERROR_OK;
+	(void)specasm_state_add_long_e("new");
+	if (err_type != SPECASM_ERROR_TOO_MANY_LONG_STRINGS) {
+		printf("[FAIL]\n\t>long table not full\n");
+		return 1;
+	}
+	err_type = SPECASM_ERROR_OK;
+
+	specasm_save_e("strings");
+	memset(&state, 0, sizeof(state));
+	specasm_state_index_strings();
+	specasm_load_e("strings");
+	if (err_type != SPECASM_ERROR_OK) {
+		printf("[FAIL]\n\t>load: %s\n", error_msgs[err_type]);
+		return 1;
+	}
+
+	if (prv_check_strings("load"))
+		return 1;
+
+	specasm_state_reset();
+	if (specasm_state_add_short_e("s7") || specasm_state_add_long_e("x")) {
+		printf("[FAIL]\n\t>reset: strings not cleared\n");
+		return 1;
+	}
+
+	specasm_state_reset();
+	printf("[OK]\n");
+	return 0;
+}
+
+/*
+ * Parses the format tests into two contexts, one line at a time and
+ * alternating between the contexts, and checks that each context
+ * formats its own lines back correctly.
+ */
+
+static int prv_test_ctx()
+{
+	size_t i;
+	size_t j;
+	specasm_ctx_t ctxs[2];
+	specasm_ctx_t *ctx;
+	char buf[SPECASM_MAX_SCRATCH];
+	char buf2[SPECASM_MAX_SCRATCH];
+	const format_test_t *t;
+
+	printf("context: ");
+	specasm_ctx_init(&ctxs[0]);
+	specasm_ctx_init(&ctxs[1]);
+	err_type = SPECASM_ERROR_OK;
+	specasm_state_reset();
+
+	for (i = 0; i < format_tests_count; i++) {
+		ctx = &ctxs[i & 1];
+		specasm_ctx_append_empty_line_e(ctx);
+		memset(buf, ' ', SPECASM_LINE_MAX_LEN);
+		buf[SPECASM_LINE_MAX_LEN] = 0;
+		t = &format_tests[i];
+		memcpy(buf, t->source, strlen(t->source));
+		specasm_ctx_parse_line_e(ctx, i / 2, buf);
+		if (ctx->err_type != SPECASM_ERROR_OK) {
+			printf("[FAIL]\n\t>%s: %s\n", t->source,
+			       error_msgs[ctx->err_type]);
+			return 1;
+		}
+	}
+
+	if (state.lines.num_lines != 0 || err_type != SPECASM_ERROR_OK) {
+		printf("[FAIL]\n\t>global state modified\n");
+		return 1;
+	}
+
+	for (i = 0; i < format_tests_count; i++) {
+		ctx = &ctxs[i & 1];
+		t = &format_tests[i];
+		j = i / 2;
+		if (ctx->state.lines.lines[j].type != t->type) {
+			printf("[FAIL]\n\t>%s: line type mismatch\n",
+			       t->source);
+			return 1;
+		}
+		memset(buf2, ' ', SPECASM_LINE_MAX_LEN);
+		buf2[SPECASM_LINE_MAX_LEN] = 0;
+		memcpy(buf2, t->str, strlen(t->str));
+		specasm_ctx_format_line_e(ctx, buf, j);
+		if (ctx->err_type != SPECASM_ERROR_OK) {
+			printf("[FAIL]\n\t>dump: %s\n",
+			       error_msgs[ctx->err_type]);
+			return 1;
+		}
+		if (strcmp(buf, buf2)) {
+			printf("[FAIL] bad format.  Expected \n\"%s\" got "
+			       "\n\"%s\"\n",
+			       buf2, buf);
+			return 1;
+		}
+	}
+
+	printf("[OK]\n");
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	specasm_init_dump_table();
@@ -341,6 +636,10 @@ int main(int argc, char *argv[])
 	if (prv_test_format())
 		return 1;
 
+	printf("\n");
+	if (prv_test_ctx())
+		return 1;
+
 	printf("\n");
 	if (prv_test_anal())
 		return 1;
@@ -349,6 +648,18 @@ int main(int argc, char *argv[])
 	if (prv_test_bad_opcodes())
 		return 1;
 
+	printf("\n");
+	if (prv_test_mnemomics())
+		return 1;
+
+	printf("\n");
+	if (prv_test_strings())
+		return 1;
+
+	printf("\n");
+	if (prv_test_save_load())
+		return 1;
+
 	printf("\n");
 	if (prv_test_old_version())
 		return 1;
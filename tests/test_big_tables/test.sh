@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# We're testing here that, on the host, salink isn't limited by the
+# sizes of the Spectrum's tables.  There are more files, more globals,
+# more labels and more files waiting to be parsed than the Spectrum
+# versions of salink can handle.
+
+set -e
+rm -rf main *.s *.x mod 2>/dev/null 1>&2 || true
+
+mkdir mod
+for i in `seq 0 299`; do
+    printf ".Fn$i\n.la\n.lb\n.lc\n.ld\n  ret\n.Val$i equ $i\n" > mod/f$i.s
+done
+
+printf ".Main\n  call Fn299\n  ld hl, =Val299\n  ret\n- mod\n" > main.s
+
+../../saimport main.s mod/*.s
+../../salink 2>/dev/null 1>&2
+
+# The objects in mod are linked in ascending order of their names after
+# the 7 bytes of main.
+
+index=`ls mod/*.x | LC_ALL=C sort | grep -n 'mod/f299.x' | cut -d: -f1`
+addr=$((0x8000 + 7 + index - 1))
+expected=`printf 'cd %02x %02x 21 2b 01 c9' $((addr & 0xff)) $((addr >> 8))`
+got=`od -An -tx1 -N7 main | xargs`
+if [ "$got" != "$expected" ]; then
+    echo "Expected $expected got $got"
+    exit 1
+fi
+
+if [ `wc -c < main` != "307" ]; then
+    echo "main should be 307 bytes"
+    exit 1
+fi
+
+rm -rf main *.s *.x mod
@@ -0,0 +1,3 @@
+.Helper
+  ld a, 1
+  ret
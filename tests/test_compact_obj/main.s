@@ -0,0 +1,3 @@
+.Main
+  call Helper
+  ret
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# We're testing here that object files only store the lines and strings
+# that are in use and that a damaged object file is rejected.
+
+set -e
+rm main *.x 2>/dev/null 1>&2 || true
+
+../../saimport main.s helper.s
+
+# A 10 byte header, 3 lines of 7 bytes, 2 short strings of 12 bytes
+# and a 2 byte checksum.
+
+if [ `wc -c < main.x` != "57" ]; then
+    echo "Expected main.x to be 57 bytes"
+    exit 1
+fi
+
+../../salink > /dev/null
+if [ ! -f main ]; then
+    echo "main was not created"
+    exit 1
+fi
+
+rm main
+printf '\x2e' | dd of=main.x bs=1 seek=32 conv=notrunc 2>/dev/null
+if ../../salink 2>/dev/null 1>&2 ; then
+    echo "Expected corrupt file to be rejected"
+    exit 1
+fi
+
+head -c 40 helper.x > helper.tmp
+mv helper.tmp helper.x
+../../saimport main.s
+if ../../salink 2>/dev/null 1>&2 ; then
+    echo "Expected truncated file to be rejected"
+    exit 1
+fi
+
+rm main *.x 2>/dev/null 1>&2 || true
@@ -0,0 +1,6 @@
+- sub
+.Main
+  call Function
+  ret
+!data
+!d#a:ta
@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# We're testing here that --deps writes a rule for the binary and the test
+# binary listing the objects, directories and binary files they're built
+# from, and that the names make treats specially are escaped.
+
+set -e
+rm main main.tst main.d data d#a:ta *.x *.t sub/*.x 2>/dev/null 1>&2 || true
+
+printf 'abc' > data
+printf 'def' > d#a:ta
+../../saimport *.s *.ts
+pushd sub > /dev/null
+../../../saimport *.s
+popd > /dev/null
+
+cat > expected <<EXP
+main: \\
+ d\\#a\\:ta \\
+ data \\
+ main.x \\
+ sub \\
+ sub/func.x
+
+d\\#a\\:ta:
+
+data:
+
+main.x:
+
+sub:
+
+sub/func.x:
+
+main.tst: \\
+ d\\#a\\:ta \\
+ data \\
+ main.x \\
+ sub \\
+ sub/func.x \\
+ test.t
+
+d\\#a\\:ta:
+
+data:
+
+main.x:
+
+sub:
+
+sub/func.x:
+
+test.t:
+EXP
+
+for flags in "" "--single-pass"; do
+    rm main.d 2>/dev/null 1>&2 || true
+    ../../salink --deps $flags > /dev/null
+    if ! cmp -s main.d expected; then
+	echo "main.d does not match with flags \"$flags\""
+	diff main.d expected
+	exit 1
+    fi
+done
+
+rm main main.tst main.d data d#a:ta expected *.x *.t sub/*.x
@@ -0,0 +1,5 @@
+map
+- mod
+.Main
+  call Used
+  ret
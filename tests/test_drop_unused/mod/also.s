@@ -0,0 +1,2 @@
+.Also
+  db 1, 2, 3
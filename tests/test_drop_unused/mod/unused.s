@@ -0,0 +1,3 @@
+.Unused
+  call Used
+  ret
@@ -0,0 +1,3 @@
+.Used
+  ld a, =Val
+  ret
@@ -0,0 +1 @@
+.Val equ 7
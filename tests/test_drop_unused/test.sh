@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# We're testing here that --drop-unused leaves out the objects that can't
+# be reached from Main and lists them in the map file.
+
+set -e
+rm main main.map *.x mod/*.x 2>/dev/null 1>&2 || true
+
+../../saimport main.s
+pushd mod 2>/dev/null 1>&2
+../../../saimport *.s
+popd 2>/dev/null 1>&2
+
+../../salink > /dev/null
+if [ $(wc -c < main) -ne 14 ]; then
+    echo "Expected all objects to be linked without --drop-unused"
+    exit 1
+fi
+
+../../salink --drop-unused > /dev/null
+
+printf '\xcd\x04\x80\xc9\x3e\x07\xc9' > expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary"
+    exit 1
+fi
+rm expected
+
+sed -n '/^Excluded$/,$p' main.map > excluded
+printf 'Excluded\n-------\nmod/also.x\nmod/unused.x\n' > expected
+if ! cmp -s excluded expected; then
+    echo "Excluded objects not reported in main.map"
+    exit 1
+fi
+rm excluded expected
+
+if grep "Unused" main.map 2>/dev/null 1>&2; then
+    echo "Globals of excluded objects should not be in main.map"
+    exit 1
+fi
+
+rm main main.map *.x mod/*.x
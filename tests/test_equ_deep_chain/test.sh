@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# We're testing here that long chains of global and local EQUs, which are
+# declared in the opposite order to the one in which they need to be
+# evaluated, link on the host.
+
+set -e
+rm main *.s *.x 2>/dev/null 1>&2 || true
+
+for f in 0 1 2 3; do
+    for i in `seq 0 24`; do
+        j=$((f * 25 + i))
+        if [ $j -eq 99 ]; then
+            echo ".N$j equ 1" >> chain$f.s
+        else
+            echo ".N$j equ N$((j + 1))+1" >> chain$f.s
+        fi
+    done
+done
+
+echo ".Main" > main.s
+for i in `seq 0 48`; do
+    echo ".l$i equ l$((i + 1))+1" >> main.s
+done
+echo ".l49 equ N0" >> main.s
+echo "  db =N0" >> main.s
+echo "  db =l0" >> main.s
+
+../../saimport *.s
+../../salink 2>/dev/null 1>&2
+
+# db =N0, db =l0
+word=`od -An -tx1 -N2 main | xargs`
+if [ "$word" != "64 95" ]; then
+    echo "Expected 64 95 got $word"
+    exit 1
+fi
+
+rm main *.s *.x
@@ -0,0 +1,14 @@
+.Main
+  ld a, =-1+2
+  ret
+.table
+  dw =table+2
+  dw =table+2
+  dw =Count*2
+  dw =Count*2
+  db =(size<<1)
+  db =(size<<1)
+  db =Count%3
+  db =Count%3
+.size equ 3
+.Count equ 5
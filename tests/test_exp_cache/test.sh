@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# We're testing here that expressions used by more than one line of an
+# object evaluate to the same value each time they're used.  Note that
+# unary minus applies to the whole expression that follows it.
+
+set -e
+rm main *.x 2>/dev/null 1>&2 || true
+
+../../saimport main.s
+../../salink > /dev/null
+
+printf '\x3e\xfd\xc9\x05\x80\x05\x80\x0a\x00\x0a\x00\x06\x06\x02\x02' > expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary"
+    exit 1
+fi
+
+rm main expected *.x
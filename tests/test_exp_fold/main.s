@@ -0,0 +1,12 @@
+.Main
+  ld a, =8*16+4
+  ld hl, =$4000+32*8
+  ld b, =-1+2 ;neg
+  dw =1<<15
+  bit =3, a
+  ld a, (=$5c00+8)
+  cp '='
+  ld a, =(size<<1)
+  db ='a'+1
+  ret
+.size equ 3
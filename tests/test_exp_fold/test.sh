@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# We're testing here that saimport evaluates expressions that don't refer
+# to labels and stores them as ordinary immediates, and that the binary
+# is the same as it would have been had salink evaluated them.  Lines
+# that the Spectrum's saimport rejects must still be rejected.
+
+set -e
+rm main *.x export.s bad.s 2>/dev/null 1>&2 || true
+
+../../saimport main.s
+../../salink > /dev/null
+
+printf '\x3e\x84\x21\x00\x41\x06\xfd\x00\x80\xcb\x5f\x3a\x08\x5c\xfe\x3d\x3e\x06\x62\xc9' > expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary"
+    exit 1
+fi
+
+cp main.x export.x
+../../saexport export.x
+if [ `grep -c = export.s` != "3" ]; then
+    echo "expressions without labels were not folded"
+    exit 1
+fi
+
+for line in '  ds =2+2, 1' '  ds 2, =1+1' '  db =1+1, 2' \
+          '  ld a, (ix+=2*2)' '  ld a, (iy+=-3)'; do
+    printf '.Main\n%s\n  ret\n' "$line" > bad.s
+    if ../../saimport bad.s 2> /dev/null; then
+        echo "\"$line\" should not import"
+        exit 1
+    fi
+done
+
+rm main expected *.x export.s bad.s
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# We're testing here that saimport --cache only imports the source
+# files, and only rewrites the object files, that need it.
+
+set -e
+rm *.x .saimport.cache ref 2>/dev/null 1>&2 || true
+cp main.s main.bak
+
+../../saimport --cache main.s helper.s
+if [ `grep -c "main.s\|helper.s" .saimport.cache` != "2" ]; then
+    echo "Expected two entries in the cache"
+    exit 1
+fi
+
+touch -t 200001010000 main.x helper.x
+touch -t 200101010000 ref
+
+../../saimport --cache main.s helper.s
+if [ main.x -nt ref ] || [ helper.x -nt ref ]; then
+    echo "Unchanged object files were rewritten"
+    exit 1
+fi
+
+echo "  nop" >> main.s
+../../saimport --cache main.s helper.s
+if [ ! main.x -nt ref ]; then
+    echo "main.x was not rewritten"
+    exit 1
+fi
+if [ helper.x -nt ref ]; then
+    echo "helper.x was rewritten"
+    exit 1
+fi
+
+# Modified object files should be regenerated.
+
+cp helper.x helper.good
+echo "garbage" >> helper.x
+../../saimport --cache main.s helper.s
+if ! cmp -s helper.x helper.good; then
+    echo "helper.x was not regenerated"
+    exit 1
+fi
+
+mv main.bak main.s
+rm *.x .saimport.cache ref helper.good
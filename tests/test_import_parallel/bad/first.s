@@ -0,0 +1,2 @@
+.First
+  ld a, (hl
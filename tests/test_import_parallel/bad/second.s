@@ -0,0 +1,3 @@
+.Second
+  ret
+  jp (
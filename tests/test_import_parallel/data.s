@@ -0,0 +1,4 @@
+.Buffer
+ds 16, 0
+!data
+.Data_end
@@ -0,0 +1,7 @@
+map
+- module
+.Main
+  call Function
+  call Copy
+  ld hl, =Table_end-Table
+  jp Helper
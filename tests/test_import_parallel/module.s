@@ -0,0 +1,4 @@
+.Function
+  call Other
+  ld a, 0
+  ret
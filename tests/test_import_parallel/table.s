@@ -0,0 +1,6 @@
+align 16
+.Table
+db 1, 2, 3, 4
+db 5, 6, 7, 8
+.Table_end
+.Entries equ Table_end-Table
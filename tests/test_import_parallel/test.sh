@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# We're testing here that importing files on multiple threads produces
+# the same object files and the same errors as importing them on one.
+
+set -e
+rm -rf serial 2>/dev/null 1>&2 || true
+rm *.x bad/*.x 2>/dev/null 1>&2 || true
+
+../../saimport -j 1 *.s
+mkdir serial
+mv *.x serial
+
+../../saimport -j 4 *.s
+
+for i in serial/*.x; do
+    if ! cmp -s $i `basename $i`; then
+	echo "`basename $i` differs from serial import"
+	exit 1
+    fi
+done
+
+# Only the error from the first bad file on the command line should be
+# reported.
+
+if ../../saimport -j 1 main.s bad/second.s helper.s bad/first.s 2> serial/err; then
+    echo "Expected serial import to fail"
+    exit 1
+fi
+
+if ../../saimport -j 4 main.s bad/second.s helper.s bad/first.s 2> err; then
+    echo "Expected parallel import to fail"
+    exit 1
+fi
+
+if ! cmp -s err serial/err; then
+    echo "Unexpected error: `cat err`"
+    exit 1
+fi
+
+rm -rf serial
+rm err *.x bad/*.x 2>/dev/null 1>&2 || true
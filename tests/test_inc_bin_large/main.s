@@ -0,0 +1,7 @@
+.Main
+db 1
+!big
+db 2
+!empty
+!big
+db 3
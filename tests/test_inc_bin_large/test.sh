@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# We're testing here that large and empty included binaries are copied
+# into the output intact, and that the bytes written around them end up
+# in the right places.
+
+set -e
+rm main big empty expected *.x 2>/dev/null 1>&2 || true
+
+head -c 12000 /dev/urandom > big
+: > empty
+
+../../saimport *.s
+../../salink > /dev/null
+
+printf '\x01' > expected
+cat big >> expected
+printf '\x02' >> expected
+cat big >> expected
+printf '\x03' >> expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary"
+    exit 1
+fi
+
+rm main big empty expected *.x
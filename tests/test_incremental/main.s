@@ -0,0 +1,4 @@
+.Main
+  call FuncA
+  call FuncB
+  ret
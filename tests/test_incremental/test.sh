@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# We're testing here that --incremental copies the objects that haven't
+# changed from the previous binary and that the binary it produces is
+# identical to the one produced by a full link.
+
+set -e
+rm main main.lnk incremental a.s b.s output *.x 2>/dev/null 1>&2 || true
+
+check_link() {
+    ../../salink --incremental > output
+    if ! grep -q "$1" output; then
+	echo "$1 expected"
+	cat output
+	exit 1
+    fi
+    cp main incremental
+    ../../salink > /dev/null
+    if ! cmp -s main incremental; then
+	echo "incremental binary differs from the full link: $1"
+	exit 1
+    fi
+    mv incremental main
+}
+
+printf '.FuncA\n  ld a, 1\n  ret\n' > a.s
+printf '.FuncB\n  ld a, 2\n  ld hl, data\n  ret\n.data\n  db 1, 2, 3\n' > b.s
+../../saimport *.s
+check_link "Reused 0 of 3 objects"
+check_link "Reused 3 of 3 objects"
+
+# Same size and same globals.  Only b.x needs to be linked.
+
+printf '.FuncB\n  ld a, 3\n  ld hl, data\n  ret\n.data\n  db 4, 5, 6\n' > b.s
+../../saimport b.s
+check_link "Reused 2 of 3 objects"
+
+# b.x, the last object, grows.  Nothing else moves.
+
+printf '.FuncB\n  ld a, 3\n  ld hl, data\n  ret\n.data\n  db 4, 5, 6, 7\n' > b.s
+../../saimport b.s
+check_link "Reused 2 of 3 objects"
+
+# a.x grows, moving FuncB, so nothing can be reused.
+
+printf '.FuncA\n  ld a, 1\n  nop\n  ret\n' > a.s
+../../saimport a.s
+check_link "Reused 0 of 3 objects"
+
+# A binary that doesn't match the state file isn't reused.
+
+check_link "Reused 3 of 3 objects"
+printf '\x00' | dd of=main bs=1 seek=1 conv=notrunc 2>/dev/null
+check_link "Reused 0 of 3 objects"
+
+rm main main.lnk a.s b.s output *.x
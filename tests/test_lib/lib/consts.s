@@ -0,0 +1 @@
+.Width equ 32
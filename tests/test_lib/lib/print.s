@@ -0,0 +1,3 @@
+.Print
+  call Putc
+  ret
@@ -0,0 +1,3 @@
+.Putc
+  ld a, =Width
+  ret
@@ -0,0 +1,3 @@
+.Unused
+  ld a, 1
+  ret
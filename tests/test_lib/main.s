@@ -0,0 +1,5 @@
+map
+- lib/util.lib
+.Main
+  call Print
+  ret
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# We're testing here that salink only links the library members that
+# define globals the program uses, including globals used by other
+# members and globals used in expressions.
+
+set -e
+rm main main.map *.x lib/*.x lib/*.lib 2>/dev/null 1>&2 || true
+
+../../saimport main.s
+pushd lib 2>/dev/null 1>&2
+../../../saimport *.s
+../../../salib util.lib *.x
+rm *.x
+popd 2>/dev/null 1>&2
+
+../../salink > /dev/null
+
+printf '\xcd\x04\x80\xc9\xcd\x08\x80\xc9\x3e\x20\xc9' > expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary"
+    exit 1
+fi
+rm expected
+
+if grep "Unused" main.map 2>/dev/null 1>&2; then
+    echo "unused.x should not have been linked"
+    exit 1
+fi
+
+pushd lib 2>/dev/null 1>&2
+../../../saimport print.s
+if ../../../salib dup.lib print.x print.x 2>/dev/null; then
+    echo "Expected salib to reject members with the same name"
+    exit 1
+fi
+rm print.x
+popd 2>/dev/null 1>&2
+
+rm main main.map
+echo "not a library" > lib/util.lib
+if ../../salink 2>/dev/null 1>&2 ; then
+    echo "Expected a bad library to be rejected"
+    exit 1
+fi
+
+rm main main.map *.x lib/*.lib 2>/dev/null 1>&2 || true
@@ -0,0 +1,4 @@
+.Main
+  call Sub
+.loop
+  jr loop
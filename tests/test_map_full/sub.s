@@ -0,0 +1,8 @@
+.Sub
+  ld a, 1
+  ret
+  align 16
+.table
+  db 1, 2
+.Table2
+  db 3
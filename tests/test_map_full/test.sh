@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# We're testing here that --map-full adds the object ranges and label
+# lines to the map and writes a binary symbol file sorted by address.
+
+set -e
+rm main main.map main.sym *.x 2>/dev/null 1>&2 || true
+
+../../saimport *.s
+../../salink --map-full > /dev/null
+
+for f in "Start \$8000 End \$8005 Size 5 Padding 0" \
+	 "Start \$8005 End \$8013 Size 6 Padding 8" \
+	 "loop line 2" "table line 4" "Table2 line 6"; do
+    if ! grep -q "$f" main.map; then
+	echo "$f missing from main.map"
+	exit 1
+    fi
+done
+
+magic=`head -c 4 main.sym`
+if [ "$magic" != "SSYM" ]; then
+    echo "SSYM expected got $magic"
+    exit 1
+fi
+
+counts=`od -An -j4 -tu2 -N4 main.sym | xargs`
+if [ "$counts" != "1 2" ]; then
+    echo "version 1 and 2 objects expected got $counts"
+    exit 1
+fi
+
+syms=`od -An -j8 -tu4 -N4 main.sym | xargs`
+if [ "$syms" != "5" ]; then
+    echo "5 symbols expected got $syms"
+    exit 1
+fi
+
+# The addresses of the symbols follow the two object records.
+
+for i in 0 1 2 3 4; do
+    addrs="$addrs `od -An -j$((32 + i * 12)) -tx2 -N2 main.sym | xargs`"
+done
+if [ "$addrs" != " 8000 8003 8005 8010 8012" ]; then
+    echo "sorted addresses expected got$addrs"
+    exit 1
+fi
+
+rm main main.map main.sym *.x
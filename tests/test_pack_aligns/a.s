@@ -0,0 +1,3 @@
+align 256
+.Table
+db 1
@@ -0,0 +1,2 @@
+.Big
+ds 100, 2
@@ -0,0 +1,2 @@
+.Small
+ds 50, 3
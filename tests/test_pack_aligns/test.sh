@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# We're testing here that --pack-aligns fills the gap in front of an
+# aligned object with objects that don't need aligning.
+
+set -e
+rm main *.x 2>/dev/null 1>&2 || true
+
+../../saimport *.s
+
+../../salink > /dev/null
+if [ $(wc -c < main) -ne 407 ]; then
+    echo "Expected objects to be linked in name order without --pack-aligns"
+    exit 1
+fi
+
+../../salink --pack-aligns > output
+printf '\xc9' > expected
+head -c 100 /dev/zero | tr '\0' '\2' >> expected
+head -c 50 /dev/zero | tr '\0' '\3' >> expected
+head -c 105 /dev/zero >> expected
+printf '\x01' >> expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary"
+    exit 1
+fi
+if ! grep -q "Packing saved 150 bytes" output; then
+    echo "Padding saved not reported"
+    exit 1
+fi
+
+rm main expected output *.x
@@ -0,0 +1,9 @@
+.Helper
+  ld a, (hl)
+  ret
+.Copy
+  ld hl, Table
+  ld de, Buffer
+  ld bc, =Table_end-Table
+  ldir
+  ret
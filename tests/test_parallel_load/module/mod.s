@@ -0,0 +1,5 @@
+- sub
+.Function
+  call Other
+  ld a, 0
+  ret
@@ -0,0 +1,3 @@
+.Other
+  ld a, =Entries
+  ret
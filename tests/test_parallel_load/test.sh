@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# We're testing here that loading the objects on multiple threads
+# produces the same binary and map file as loading them on one.
+
+set -e
+rm main main.map data 2>/dev/null 1>&2 || true
+rm -rf serial 2>/dev/null 1>&2 || true
+rm *.x module/*.x module/sub/*.x 2>/dev/null 1>&2 || true
+
+cat /dev/zero | head -c 300 | tr '\000' '\001' > data
+
+../../saimport *.s
+pushd module 2>/dev/null 1>&2
+../../../saimport *.s
+cd sub
+../../../../saimport *.s
+popd 2>/dev/null 1>&2
+
+../../salink -j 1 2>/dev/null 1>&2
+mkdir serial
+mv main main.map serial
+
+../../salink -j 4 2>/dev/null 1>&2
+
+if ! cmp -s main serial/main; then
+    echo "main differs from serial link"
+    exit 1
+fi
+
+if ! cmp -s main.map serial/main.map; then
+    echo "main.map differs from serial link"
+    exit 1
+fi
+
+rm -rf serial
+rm main main.map data *.x module/*.x module/sub/*.x
@@ -0,0 +1,10 @@
+.Main
+  jr farl
+  djnz farl
+  jp near
+.near
+  call Sub
+  ret
+align 256
+.farl
+  jp Sub
@@ -0,0 +1,2 @@
+.Sub
+  jp Main
@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# We're testing here that --relax widens the jr and djnz that can't reach
+# their targets and that --relax-size also narrows the jps that can.
+
+set -e
+rm main *.x 2>/dev/null 1>&2 || true
+
+../../saimport *.s
+
+if ../../salink 2>/dev/null 1>&2 ; then
+    echo "Expected link to fail without --relax"
+    exit 1
+fi
+
+../../salink --relax > output
+printf '\xc3\x00\x81\x05\xc2\x00\x81\xc3\x0a\x80\xcd\x03\x81\xc9' > expected
+head -c 242 /dev/zero >> expected
+printf '\xc3\x03\x81\xc3\x00\x80' >> expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary with --relax"
+    exit 1
+fi
+if ! grep -q "3 bytes added by relaxation" output; then
+    echo "Relaxation not reported with --relax"
+    exit 1
+fi
+
+../../salink --relax-size > output
+printf '\xc3\x00\x81\x05\xc2\x00\x81\x18\x00\xcd\x02\x81\xc9' > expected
+head -c 243 /dev/zero >> expected
+printf '\x18\x00\xc3\x00\x80' >> expected
+if ! cmp -s main expected; then
+    echo "main does not match the expected binary with --relax-size"
+    exit 1
+fi
+if ! grep -q "1 byte added by relaxation" output; then
+    echo "Relaxation not reported"
+    exit 1
+fi
+
+rm main expected output *.x
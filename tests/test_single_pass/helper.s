@@ -0,0 +1,7 @@
+.Helper
+  ld a, (hl)
+  ret
+align 16
+.Data
+db 1, 2, 3, 4
+.Data_end
@@ -0,0 +1,7 @@
+map
+- module
+- module/test.t
+.Main
+  call Function
+  ld hl, =Data_end-Data
+  jp Helper
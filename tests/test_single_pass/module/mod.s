@@ -0,0 +1,3 @@
+.Function
+  ld a, 0	
+  ret	
@@ -0,0 +1,5 @@
+- sub
+- tt/t2.t
+.B
+  call C
+  ret
@@ -0,0 +1,4 @@
+- tt/t1.t
+.Main
+  call B
+  ret
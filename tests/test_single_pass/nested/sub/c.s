@@ -0,0 +1,4 @@
+- t3.t
+.C
+  ld a, 0
+  ret
@@ -0,0 +1,4 @@
+.TestT3
+  call C
+  ld bc, 0
+  ret
@@ -0,0 +1,4 @@
+.TestT1
+  call C
+  ld bc, 0
+  ret
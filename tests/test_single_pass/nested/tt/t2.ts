@@ -0,0 +1,4 @@
+.TestT2
+  call C
+  ld bc, 0
+  ret
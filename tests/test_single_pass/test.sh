@@ -0,0 +1,77 @@
+#!/bin/bash
+
+. ../utils/unit.sh
+
+# We're testing here that linking the main and the test binaries in a
+# single pass produces the same binaries as linking them separately.
+
+set -e
+rm main main.tst main.map main.tmt 2>/dev/null 1>&2 || true
+rm -rf two_pass 2>/dev/null 1>&2 || true
+rm *.x *.t module/*.x module/*.t 2>/dev/null 1>&2 || true
+
+../../saimport *.s *.ts
+pushd module 2>/dev/null 1>&2
+../../../saimport *.s *.ts
+popd 2>/dev/null 1>&2
+
+../../salink 2>/dev/null 1>&2
+mkdir two_pass
+mv main main.tst two_pass
+
+../../salink --single-pass 2>/dev/null 1>&2
+
+if ! cmp -s main two_pass/main; then
+    echo "main differs from two pass link"
+    exit 1
+fi
+
+if ! cmp -s main.tst two_pass/main.tst; then
+    echo "main.tst differs from two pass link"
+    exit 1
+fi
+
+test_names=$( dump_test_names main.tst 32768)
+if [ "$test_names" != "Helper Function" ]; then
+    echo "Expected Helper Function got $test_names"
+    exit 1
+fi
+
+rm -rf two_pass
+rm main main.tst main.map main.tmt *.x *.t module/*.x module/*.t
+
+# The .t files here are included by objects at different depths of the
+# include graph.  The tests should still appear in the same order.
+
+pushd nested 2>/dev/null 1>&2
+rm main main.tst main.map main.tmt 2>/dev/null 1>&2 || true
+rm -rf two_pass 2>/dev/null 1>&2 || true
+rm *.x sub/*.x sub/*.t tt/*.t 2>/dev/null 1>&2 || true
+
+../../../saimport *.s sub/*.s sub/*.ts tt/*.ts
+
+../../../salink 2>/dev/null 1>&2
+mkdir two_pass
+mv main main.tst two_pass
+
+../../../salink --single-pass 2>/dev/null 1>&2
+
+if ! cmp -s main two_pass/main; then
+    echo "nested main differs from two pass link"
+    exit 1
+fi
+
+if ! cmp -s main.tst two_pass/main.tst; then
+    echo "nested main.tst differs from two pass link"
+    exit 1
+fi
+
+test_names=$( dump_test_names main.tst 32768)
+if [ "$test_names" != "T1 T2 T3" ]; then
+    echo "Expected T1 T2 T3 got $test_names"
+    exit 1
+fi
+
+rm -rf two_pass
+rm main main.tst *.x sub/*.x sub/*.t tt/*.t
+popd 2>/dev/null 1>&2
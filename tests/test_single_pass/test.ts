@@ -0,0 +1,10 @@
+.TestHelper
+  ld hl, Data
+  call Helper
+  cp 1
+  jr z, good
+  ld bc, 1
+  ret
+.good
+  ld bc, 0
+  ret
@@ -0,0 +1,4 @@
+.Main
+  ld a, =Val+1
+  call Sub
+  ret
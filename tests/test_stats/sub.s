@@ -0,0 +1,3 @@
+.Sub
+  ret
+.Val equ 2*3
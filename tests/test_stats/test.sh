@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# We're testing here that --stats and --stats-json report the work done
+# by the link.
+
+set -e
+rm main stats.json *.x 2>/dev/null 1>&2 || true
+
+../../saimport *.s
+
+../../salink --stats --stats-json stats.json > output
+
+for f in "Objects parsed    2" "Bytes written     7" "Phase        ms"; do
+    if ! grep -q "$f" output; then
+        echo "$f missing from the stats"
+        exit 1
+    fi
+done
+
+for f in '"objects_parsed": 2,' '"bytes_written": 7,' '"passes": 1,' \
+	 '"total": '; do
+    if ! grep -q "$f" stats.json; then
+        echo "$f missing from stats.json"
+        exit 1
+    fi
+done
+
+if grep -q '"expression_evals": 0' stats.json; then
+    echo "Expressions were not counted"
+    exit 1
+fi
+
+rm main stats.json output *.x